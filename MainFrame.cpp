@@ -2,8 +2,20 @@
 //
 
 #include "stdafx.h"
+#include "log_index.h"
 #include "file_writer.h"
+#include "log_compactor.h"
+#include "checkpoint.h"
+#include "shared_memory.h"
+#include "live_stats.h"
+#include "app_identity_table.h"
+#include "adaptive_sampling.h"
+#include "input_accounting.h"
+#include "trace_recorder.h"
+#include "input_trace.h"
 #include "raw_input.h"
+#include "stress_generator.h"
+#include "compaction_benchmark.h"
 
 // Switched to a new app
 bool on_app_switched(HWND window_handle)
@@ -18,6 +30,7 @@ bool on_app_switched(HWND window_handle)
 	::GetWindowThreadProcessId(window_handle, &process_id);
 	if (process_id)
 	{
+		CTraceScope process_lookup_trace_scope("on_app_switched process lookup");
 		HANDLE process_handle = ::OpenProcess(PROCESS_QUERY_INFORMATION | PROCESS_VM_READ, FALSE, process_id);
 		if (process_handle)
 		{
@@ -29,6 +42,8 @@ bool on_app_switched(HWND window_handle)
 
 			::CloseHandle(process_handle);
 		}
+		process_lookup_trace_scope.end();
+
 		g_raw_input->on_app_switched(current_app_path);
 
 		return true;
@@ -75,6 +90,10 @@ LRESULT CALLBACK window_proc(HWND window_handle, UINT window_message, WPARAM wpa
 		g_raw_input->read_input_data(lparam);
 		break;
 
+	case WM_INPUT_SAMPLING_MODE_CHANGED:
+		g_raw_input->apply_sampling_mode();
+		break;
+
 	default:
 		return ::DefWindowProc(window_handle, window_message, wparam, lparam);
 	}
@@ -86,6 +105,62 @@ int WINAPI wWinMain(HINSTANCE current_instance, HINSTANCE previous_instance, LPW
 {
 	wchar_t window_class_name[] = L"window_class_name";
 
+	// Record a timeline of the input processing which is dumped as a Chrome trace on exit
+	bool is_tracing_enabled = cmd && (wcsstr(cmd, L"/trace") || wcsstr(cmd, L"--trace"));
+	g_trace_recorder->enable(is_tracing_enabled);
+
+	// Stress the accounting core instead of monitoring, the exit code tells whether any accounting invariant was violated
+	if (cmd && (wcsstr(cmd, L"/stress") || wcsstr(cmd, L"--stress")))
+	{
+		CStressGenerator stress_generator;
+		SStressResult stress_result = stress_generator.run();
+
+		::OutputDebugString(std::wstring(L"\n\t**Stress: " + std::to_wstring(stress_result.event_count) + L" events in " +
+			std::to_wstring(stress_result.elapsed_time) + L" ms (" + std::to_wstring(stress_result.events_per_second) + L" events/s), " +
+			std::to_wstring(stress_result.invariant_violation_count) + L" of " + std::to_wstring(stress_result.invariant_check_count) + L" invariant checks failed, " +
+			std::to_wstring(stress_result.accumulated_time) + L" ms accumulated, " + std::to_wstring(stress_result.missed_input_event_count) + L" missed events, " +
+			std::to_wstring(stress_result.drained_input_event_count) + L" held inputs released by the timer, " + (stress_result.is_drained ? L"drained" : L"not drained")).data());
+
+		return stress_result.invariant_violation_count == 0 && stress_result.is_drained ? 0 : 1;
+	}
+
+	// Measure the log compaction on a synthetic log instead of monitoring, the exit code tells whether every segment was compacted
+	if (cmd && (wcsstr(cmd, L"/benchmark_compaction") || wcsstr(cmd, L"--benchmark_compaction")))
+	{
+		CCompactionBenchmark compaction_benchmark;
+		SCompactionBenchmarkResult benchmark_result = compaction_benchmark.run();
+
+		const SCompactionStatistics &compaction_statistics = benchmark_result.compaction_statistics;
+		::OutputDebugString(std::wstring(L"\n\t**Compaction benchmark: " + std::to_wstring(compaction_statistics.compacted_segments) + L" segments, " +
+			std::to_wstring(compaction_statistics.records_read) + L" -> " + std::to_wstring(compaction_statistics.records_written) + L" records, " +
+			std::to_wstring(compaction_statistics.bytes_read) + L" -> " + std::to_wstring(compaction_statistics.bytes_written) + L" bytes (" +
+			std::to_wstring(benchmark_result.space_saving) + L"% saved), " + std::to_wstring(benchmark_result.records_per_second) + L" records/s, " +
+			std::to_wstring(benchmark_result.bytes_per_second) + L" bytes/s, " + std::to_wstring(benchmark_result.elapsed_time) + L" ms at background priority, " +
+			(benchmark_result.is_complete ? L"complete" : L"incomplete")).data());
+
+		return benchmark_result.is_complete ? 0 : 1;
+	}
+
+	// Host the app identity table shared by the monitors of every session instead of monitoring. Only a service or SYSTEM can create it
+	// for every user, and the table is gone with its last handle, so the host keeps it open until it's asked to quit.
+	if (cmd && (wcsstr(cmd, L"/host_shared_app_ids") || wcsstr(cmd, L"--host_shared_app_ids")))
+	{
+		CAppIdentityTable app_identity_table;
+		if (!app_identity_table.create())
+		{
+			::OutputDebugString(std::wstring(L"\n\t**Host: the shared app identity table can't be created, error " + std::to_wstring(::GetLastError())).data());
+			return 1;
+		}
+
+		MSG message = { 0 };
+		while (::GetMessage(&message, nullptr, 0, 0))
+		{
+			::DispatchMessage(&message);
+		}
+
+		return 0;
+	}
+
 	// Register the window class
 	WNDCLASSEX window_class_ex = { 0 };
 	window_class_ex.cbSize = sizeof(WNDCLASSEX);
@@ -117,7 +192,16 @@ int WINAPI wWinMain(HINSTANCE current_instance, HINSTANCE previous_instance, LPW
 		return 1;
 	}
 
-	if (!g_raw_input->init(window_handle))
+	// Throttle raw mouse input while the mouse is in continuous use
+	bool is_adaptive_sampling_enabled = cmd && (wcsstr(cmd, L"/adaptive") || wcsstr(cmd, L"--adaptive"));
+
+	// Share the app ids with the monitors of the other sessions on a terminal server, through the table the host keeps open
+	bool is_app_identity_table_enabled = cmd && (wcsstr(cmd, L"/shared_app_ids") || wcsstr(cmd, L"--shared_app_ids"));
+
+	// Record the raw input to replay the sampling policy against
+	bool is_input_recorded = cmd && (wcsstr(cmd, L"/record_input") || wcsstr(cmd, L"--record_input"));
+
+	if (!g_raw_input->init(window_handle, is_adaptive_sampling_enabled, is_app_identity_table_enabled, is_input_recorded))
 	{
 		return 1;
 	}
@@ -141,5 +225,12 @@ int WINAPI wWinMain(HINSTANCE current_instance, HINSTANCE previous_instance, LPW
 
 	::UnhookWinEvent(window_event_hook);
 
+	if (is_tracing_enabled)
+	{
+		// Stop recording before the recorder is torn down along with the other globals
+		g_trace_recorder->enable(false);
+		g_trace_recorder->dump(L"app_input_trace.json");
+	}
+
 	return static_cast<int>(message.wParam);
 }
\ No newline at end of file
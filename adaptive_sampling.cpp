@@ -0,0 +1,103 @@
+//
+//
+
+#include "stdafx.h"
+
+#include "adaptive_sampling.h"
+
+CAdaptiveSamplingPolicy::CAdaptiveSamplingPolicy(uint64_t enter_duration, uint64_t enter_gap, uint64_t exit_idle, uint64_t probe_interval)
+{
+	m_enter_duration = enter_duration;
+	m_enter_gap = enter_gap;
+	m_exit_idle = exit_idle;
+	m_probe_interval = probe_interval;
+
+	reset();
+}
+
+CAdaptiveSamplingPolicy::~CAdaptiveSamplingPolicy()
+{
+
+}
+
+void CAdaptiveSamplingPolicy::reset()
+{
+	m_sampling_mode = ESamplingMode::full_rate;
+	m_streak_start_time = m_last_report_time = 0;
+}
+
+bool CAdaptiveSamplingPolicy::on_mouse_report(uint64_t report_time, bool can_throttle)
+{
+	if (m_sampling_mode == ESamplingMode::probing)
+	{
+		return false;
+	}
+
+	// A gap, or activity that must be seen report by report such as a held button, starts the streak over
+	if (!can_throttle || !m_last_report_time || report_time - m_last_report_time > m_enter_gap)
+	{
+		m_streak_start_time = report_time;
+	}
+	m_last_report_time = report_time;
+
+	if (can_throttle && report_time - m_streak_start_time >= m_enter_duration)
+	{
+		m_sampling_mode = ESamplingMode::probing;
+		return true;
+	}
+
+	return false;
+}
+
+bool CAdaptiveSamplingPolicy::on_probe(uint64_t probe_time, uint64_t last_input_time)
+{
+	if (m_sampling_mode != ESamplingMode::probing)
+	{
+		return false;
+	}
+
+	// Resume full rate input once the user has gone idle. Throttling only starts again after another full streak of movement, which
+	// keeps the mode from flapping on short pauses.
+	if (probe_time > last_input_time && probe_time - last_input_time >= m_exit_idle)
+	{
+		m_sampling_mode = ESamplingMode::full_rate;
+		m_streak_start_time = m_last_report_time = 0;
+		return true;
+	}
+
+	return false;
+}
+
+bool CAdaptiveSamplingPolicy::on_held_input()
+{
+	if (m_sampling_mode != ESamplingMode::probing)
+	{
+		return false;
+	}
+
+	// The probe can't tell a held key or button from the mouse movement, so held input resumes full rate right away
+	m_sampling_mode = ESamplingMode::full_rate;
+	m_streak_start_time = m_last_report_time = 0;
+
+	return true;
+}
+
+ESamplingMode CAdaptiveSamplingPolicy::get_sampling_mode() const
+{
+	return m_sampling_mode;
+}
+
+bool CAdaptiveSamplingPolicy::is_probing() const
+{
+	return m_sampling_mode == ESamplingMode::probing;
+}
+
+uint64_t CAdaptiveSamplingPolicy::get_probe_interval() const
+{
+	return m_probe_interval;
+}
+
+uint64_t CAdaptiveSamplingPolicy::get_exit_idle() const
+{
+	return m_exit_idle;
+}
\ No newline at end of file
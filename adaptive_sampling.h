@@ -0,0 +1,54 @@
+//
+//
+
+#pragma once
+
+#define ADAPTIVE_SAMPLING_ENTER_DURATION	500 // Continuous mouse movement required before raw mouse input is throttled, in milliseconds
+
+#define ADAPTIVE_SAMPLING_ENTER_GAP			100 // A longer gap between mouse reports breaks the continuous movement, in milliseconds
+
+#define ADAPTIVE_SAMPLING_EXIT_IDLE			1000 // Idle time after which full rate raw mouse input resumes, in milliseconds
+
+#define ADAPTIVE_SAMPLING_PROBE_INTERVAL	250 // How often the last input time is polled while throttled, in milliseconds
+
+enum class ESamplingMode
+{
+	full_rate, // Every raw mouse report is received
+	probing, // Raw mouse input is off and activity is probed from the last input time
+};
+
+// Decides when raw mouse input can be throttled. Once the mouse has been moving continuously for a while, individual reports add nothing
+// to the open activity span until the user goes idle, so the span is kept open by probing the last input time instead. The span ends at
+// the last input time the probe reads, where full rate input would have ended it, except that an idle gap shorter than the exit idle time
+// plus the probe interval can fall between two probes and is counted as active. Buttons aren't received while throttled, the probe picks
+// up a held one and resumes full rate input so that its release is received. CSamplingReplay measures the difference against recorded
+// input traces.
+//
+// The policy is pure logic with no platform dependencies so that it can be replayed on any platform.
+class CAdaptiveSamplingPolicy
+{
+public:
+	CAdaptiveSamplingPolicy(uint64_t enter_duration = ADAPTIVE_SAMPLING_ENTER_DURATION, uint64_t enter_gap = ADAPTIVE_SAMPLING_ENTER_GAP,
+		uint64_t exit_idle = ADAPTIVE_SAMPLING_EXIT_IDLE, uint64_t probe_interval = ADAPTIVE_SAMPLING_PROBE_INTERVAL);
+	~CAdaptiveSamplingPolicy();
+
+	void reset();
+
+	// These return true when the sampling mode changed
+	bool on_mouse_report(uint64_t report_time, bool can_throttle);
+	bool on_probe(uint64_t probe_time, uint64_t last_input_time);
+	bool on_held_input(); // A key or button press, which has to be seen report by report
+
+	ESamplingMode get_sampling_mode() const;
+	bool is_probing() const;
+
+	uint64_t get_probe_interval() const;
+	uint64_t get_exit_idle() const;
+
+private:
+	ESamplingMode m_sampling_mode;
+
+	uint64_t m_streak_start_time, m_last_report_time;
+
+	uint64_t m_enter_duration, m_enter_gap, m_exit_idle, m_probe_interval;
+};
\ No newline at end of file
@@ -0,0 +1,185 @@
+//
+//
+
+#include "stdafx.h"
+
+#include "shared_memory.h"
+#include "app_identity_table.h"
+
+namespace
+{
+	uint32_t calculate_path_hash(const std::wstring &app_path)
+	{
+		uint32_t path_hash = 2166136261u;
+		for (const auto &path_character : app_path)
+		{
+			path_hash ^= static_cast<uint32_t>(path_character);
+			path_hash *= 16777619u;
+		}
+
+		return path_hash;
+	}
+}
+
+CAppIdentityTable::CAppIdentityTable()
+{
+	m_app_identity_table = nullptr;
+}
+
+CAppIdentityTable::~CAppIdentityTable()
+{
+	close();
+}
+
+bool CAppIdentityTable::create(const wchar_t *mapping_name)
+{
+	if (!m_shared_memory.create(mapping_name, sizeof(SAppIdentityTableRegion), true))
+	{
+		return false;
+	}
+
+	return claim_table();
+}
+
+bool CAppIdentityTable::init(const wchar_t *mapping_name)
+{
+	if (!m_shared_memory.open(mapping_name, sizeof(SAppIdentityTableRegion), true))
+	{
+		return false;
+	}
+
+	return claim_table();
+}
+
+void CAppIdentityTable::close()
+{
+	m_shared_memory.close();
+	m_app_identity_table = nullptr;
+}
+
+bool CAppIdentityTable::is_open() const
+{
+	return m_app_identity_table != nullptr;
+}
+
+uint32_t CAppIdentityTable::intern(const std::wstring &app_path)
+{
+	return lookup(app_path, true);
+}
+
+uint32_t CAppIdentityTable::find(const std::wstring &app_path) const
+{
+	return const_cast<CAppIdentityTable *>(this)->lookup(app_path, false);
+}
+
+bool CAppIdentityTable::get_app_path(uint32_t app_id, std::wstring &app_path) const
+{
+	if (!m_app_identity_table || app_id == 0 || app_id > APP_IDENTITY_TABLE_SLOT_COUNT)
+	{
+		return false;
+	}
+
+	const SAppIdentityEntry *app_identity_entry = get_entry(m_app_identity_table->slots[app_id - 1].load(std::memory_order_acquire));
+	if (!app_identity_entry)
+	{
+		return false;
+	}
+
+	app_path.assign(app_identity_entry->path, app_identity_entry->path_length);
+
+	return true;
+}
+
+bool CAppIdentityTable::claim_table()
+{
+	static_assert((APP_IDENTITY_TABLE_SLOT_COUNT & (APP_IDENTITY_TABLE_SLOT_COUNT - 1)) == 0, "The slot count must be a power of two");
+
+	m_app_identity_table = static_cast<SAppIdentityTableRegion *>(m_shared_memory.get_address());
+
+	// Either claim the zero filled table or check that it was claimed with the same layout
+	uint32_t magic = 0;
+	if (!m_app_identity_table->magic.compare_exchange_strong(magic, APP_IDENTITY_TABLE_MAGIC + APP_IDENTITY_TABLE_VERSION) &&
+		magic != APP_IDENTITY_TABLE_MAGIC + APP_IDENTITY_TABLE_VERSION)
+	{
+		close();
+		return false;
+	}
+
+	return true;
+}
+
+uint32_t CAppIdentityTable::lookup(const std::wstring &app_path, bool is_inserting)
+{
+	if (!m_app_identity_table || app_path.empty())
+	{
+		return 0;
+	}
+
+	uint32_t path_hash = calculate_path_hash(app_path);
+	uint32_t inserted_slot_value = 0; // The entry this process wrote to the arena, if any
+
+	// Linear probing, a slot only ever changes from empty to published so a probe sequence never changes under a reader
+	for (uint32_t probe_count = 0; probe_count < APP_IDENTITY_TABLE_SLOT_COUNT; probe_count++)
+	{
+		uint32_t slot_index = (path_hash + probe_count) & (APP_IDENTITY_TABLE_SLOT_COUNT - 1);
+		std::atomic<uint32_t> &slot = m_app_identity_table->slots[slot_index];
+
+		uint32_t slot_value = slot.load(std::memory_order_acquire);
+		if (slot_value == 0) // The path isn't in the table
+		{
+			if (!is_inserting)
+			{
+				return 0;
+			}
+
+			// Write the entry to the arena before publishing it, the arena space is lost if another process wins the slot
+			if (!inserted_slot_value)
+			{
+				if (m_app_identity_table->arena_used.load(std::memory_order_relaxed) >= APP_IDENTITY_TABLE_ARENA_SIZE)
+				{
+					return 0; // The arena is full
+				}
+
+				uint32_t entry_size = static_cast<uint32_t>((offsetof(SAppIdentityEntry, path) + app_path.size() * sizeof(wchar_t) + 7) & ~static_cast<size_t>(7));
+				uint32_t entry_offset = m_app_identity_table->arena_used.fetch_add(entry_size, std::memory_order_relaxed);
+				if (entry_offset > APP_IDENTITY_TABLE_ARENA_SIZE - entry_size || entry_size > APP_IDENTITY_TABLE_ARENA_SIZE)
+				{
+					return 0; // The arena is full
+				}
+
+				SAppIdentityEntry *app_identity_entry = reinterpret_cast<SAppIdentityEntry *>(m_app_identity_table->arena + entry_offset);
+				app_identity_entry->path_hash = path_hash;
+				app_identity_entry->path_length = static_cast<uint32_t>(app_path.size());
+				memcpy(app_identity_entry->path, app_path.data(), app_path.size() * sizeof(wchar_t));
+
+				inserted_slot_value = entry_offset + 1;
+			}
+
+			if (slot.compare_exchange_strong(slot_value, inserted_slot_value, std::memory_order_release, std::memory_order_acquire))
+			{
+				return slot_index + 1;
+			}
+
+			// Another process published an entry in this slot first, it could be the same path
+		}
+
+		const SAppIdentityEntry *app_identity_entry = get_entry(slot_value);
+		if (app_identity_entry && app_identity_entry->path_hash == path_hash && app_identity_entry->path_length == app_path.size() &&
+			memcmp(app_identity_entry->path, app_path.data(), app_path.size() * sizeof(wchar_t)) == 0)
+		{
+			return slot_index + 1;
+		}
+	}
+
+	return 0; // Every slot is taken
+}
+
+const SAppIdentityEntry *CAppIdentityTable::get_entry(uint32_t slot_value) const
+{
+	if (slot_value == 0 || slot_value > APP_IDENTITY_TABLE_ARENA_SIZE)
+	{
+		return nullptr;
+	}
+
+	return reinterpret_cast<const SAppIdentityEntry *>(m_app_identity_table->arena + slot_value - 1);
+}
\ No newline at end of file
@@ -0,0 +1,66 @@
+//
+//
+
+#pragma once
+
+#define APP_IDENTITY_TABLE_NAME		L"Global\\AppInputMonitorAppIdentities" // Shared by the monitors of every session on the host
+
+#define APP_IDENTITY_TABLE_MAGIC		0x54494141 // 'AAIT'
+#define APP_IDENTITY_TABLE_VERSION		1
+
+#define APP_IDENTITY_TABLE_SLOT_COUNT	16384 // Must be a power of two
+#define APP_IDENTITY_TABLE_ARENA_SIZE	8 * 1024 * 1024 // Bytes
+
+// A path stored in the arena, it's never modified once its slot has been published
+struct SAppIdentityEntry
+{
+	uint32_t path_hash;
+	uint32_t path_length; // Characters
+	wchar_t path[1];
+};
+
+// Fixed layout shared by every monitor on the host. A zero filled mapping is a valid empty table, so whoever creates it doesn't have to
+// initialize anything before others can use it.
+struct SAppIdentityTableRegion
+{
+	std::atomic<uint32_t> magic; // Claimed by the first process that maps the table, guards against an incompatible layout
+	std::atomic<uint32_t> arena_used;
+	std::atomic<uint32_t> slots[APP_IDENTITY_TABLE_SLOT_COUNT]; // Arena offset of the entry plus one, zero while empty
+	byte arena[APP_IDENTITY_TABLE_ARENA_SIZE];
+};
+
+// Append-only table interning app image paths into ids that are stable across every monitor on the host. Lookups never lock and an
+// insert publishes a fully written entry with a single compare-and-swap, so any number of processes can intern the same or different
+// paths concurrently. An app id is the index of its slot plus one, zero means no id.
+//
+// A user session can't create the table. Creating a global object needs SeCreateGlobalPrivilege, which standard users don't have, and the
+// default DACL of the creator would keep the users of the other sessions out. The table is created by the host, the monitor started with
+// /host_shared_app_ids as a service or as SYSTEM, which grants every signed in user read and write access and keeps the table alive. The
+// monitors only open it and don't start without it, rather than interning ids no other session can resolve.
+class CAppIdentityTable
+{
+public:
+	CAppIdentityTable();
+	~CAppIdentityTable();
+
+	bool create(const wchar_t *mapping_name = APP_IDENTITY_TABLE_NAME); // Creates the table for every user or opens the existing one
+	bool init(const wchar_t *mapping_name = APP_IDENTITY_TABLE_NAME); // Opens the table the host created
+	void close();
+
+	bool is_open() const;
+
+	uint32_t intern(const std::wstring &app_path);
+	uint32_t find(const std::wstring &app_path) const;
+
+	bool get_app_path(uint32_t app_id, std::wstring &app_path) const;
+
+private:
+	bool claim_table();
+
+	uint32_t lookup(const std::wstring &app_path, bool is_inserting);
+
+	const SAppIdentityEntry *get_entry(uint32_t slot_value) const;
+
+	CSharedMemory m_shared_memory;
+	SAppIdentityTableRegion *m_app_identity_table;
+};
\ No newline at end of file
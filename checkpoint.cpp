@@ -0,0 +1,164 @@
+//
+//
+
+#include "stdafx.h"
+
+#include "file_system.h"
+#include "checkpoint.h"
+
+namespace
+{
+	// Compact binary layout of a checkpoint file:
+	//	magic | version | log segment | log position | pending duration | app path length | app path | checksum
+	template <typename T>
+	void append_value(std::vector<byte> &buffer, const T &value)
+	{
+		const byte *value_bytes = reinterpret_cast<const byte *>(&value);
+		buffer.insert(buffer.end(), value_bytes, value_bytes + sizeof(T));
+	}
+
+	template <typename T>
+	bool extract_value(const std::vector<byte> &buffer, size_t &offset, T &value)
+	{
+		if (offset + sizeof(T) > buffer.size())
+		{
+			return false;
+		}
+
+		memcpy(&value, buffer.data() + offset, sizeof(T));
+		offset += sizeof(T);
+
+		return true;
+	}
+
+	// FNV-1a so that a torn or corrupted checkpoint is never trusted
+	uint32_t calculate_checksum(const byte *data, size_t size)
+	{
+		uint32_t checksum = 2166136261u;
+		for (size_t index = 0; index < size; index++)
+		{
+			checksum ^= data[index];
+			checksum *= 16777619u;
+		}
+
+		return checksum;
+	}
+}
+
+CCheckpoint::CCheckpoint()
+{
+	m_saved_checkpoint_state = {};
+	m_is_saved = false;
+}
+
+CCheckpoint::~CCheckpoint()
+{
+
+}
+
+bool CCheckpoint::init(const wchar_t *file_name)
+{
+	if (!file_name || !*file_name)
+	{
+		return false;
+	}
+
+	m_file_name = file_name;
+	m_temp_file_name = m_file_name + L".tmp";
+	m_is_saved = false;
+
+	return true;
+}
+
+bool CCheckpoint::save(const SCheckpointState &checkpoint_state)
+{
+	if (m_file_name.empty())
+	{
+		return false;
+	}
+
+	// Nothing happened since the last save, so the file on disk is still current
+	if (is_saved(checkpoint_state))
+	{
+		return true;
+	}
+
+	std::vector<byte> checkpoint_buffer;
+	checkpoint_buffer.reserve(64 + checkpoint_state.app_path.size() * sizeof(wchar_t));
+
+	append_value(checkpoint_buffer, static_cast<uint32_t>(INPUT_MONITOR_CHECKPOINT_MAGIC));
+	append_value(checkpoint_buffer, static_cast<uint32_t>(INPUT_MONITOR_CHECKPOINT_VERSION));
+	append_value(checkpoint_buffer, checkpoint_state.log_segment);
+	append_value(checkpoint_buffer, checkpoint_state.log_position);
+	append_value(checkpoint_buffer, checkpoint_state.pending_duration);
+	append_value(checkpoint_buffer, static_cast<uint32_t>(checkpoint_state.app_path.size()));
+	const byte *app_path_bytes = reinterpret_cast<const byte *>(checkpoint_state.app_path.data());
+	checkpoint_buffer.insert(checkpoint_buffer.end(), app_path_bytes, app_path_bytes + checkpoint_state.app_path.size() * sizeof(wchar_t));
+	append_value(checkpoint_buffer, calculate_checksum(checkpoint_buffer.data(), checkpoint_buffer.size()));
+
+	// Write the whole checkpoint to a temporary file first and only then replace the previous one, so a crash at any point leaves
+	// either the old or the new checkpoint on disk but never a partially written one
+	m_is_saved = false;
+	if (!CFileSystem::write_file(m_temp_file_name, checkpoint_buffer) || !CFileSystem::replace_file(m_temp_file_name, m_file_name))
+	{
+		return false;
+	}
+
+	m_saved_checkpoint_state = checkpoint_state;
+	m_is_saved = true;
+
+	return true;
+}
+
+bool CCheckpoint::load(SCheckpointState &checkpoint_state)
+{
+	if (m_file_name.empty())
+	{
+		return false;
+	}
+
+	m_is_saved = false;
+
+	std::vector<byte> checkpoint_buffer;
+	if (!CFileSystem::read_file(m_file_name, checkpoint_buffer) || checkpoint_buffer.size() < sizeof(uint32_t))
+	{
+		return false;
+	}
+
+	// Verify the checksum stored at the end of the checkpoint before trusting any of its fields
+	size_t checksum_offset = checkpoint_buffer.size() - sizeof(uint32_t);
+	uint32_t stored_checksum = 0;
+	extract_value(checkpoint_buffer, checksum_offset, stored_checksum);
+	if (stored_checksum != calculate_checksum(checkpoint_buffer.data(), checkpoint_buffer.size() - sizeof(uint32_t)))
+	{
+		return false;
+	}
+	checkpoint_buffer.resize(checkpoint_buffer.size() - sizeof(uint32_t));
+
+	size_t offset = 0;
+	uint32_t magic = 0, version = 0, app_path_length = 0;
+	if (!extract_value(checkpoint_buffer, offset, magic) || magic != INPUT_MONITOR_CHECKPOINT_MAGIC ||
+		!extract_value(checkpoint_buffer, offset, version) || version != INPUT_MONITOR_CHECKPOINT_VERSION ||
+		!extract_value(checkpoint_buffer, offset, checkpoint_state.log_segment) ||
+		!extract_value(checkpoint_buffer, offset, checkpoint_state.log_position) ||
+		!extract_value(checkpoint_buffer, offset, checkpoint_state.pending_duration) ||
+		!extract_value(checkpoint_buffer, offset, app_path_length) ||
+		offset + app_path_length * sizeof(wchar_t) != checkpoint_buffer.size())
+	{
+		return false;
+	}
+
+	checkpoint_state.app_path.assign(reinterpret_cast<const wchar_t *>(checkpoint_buffer.data() + offset), app_path_length);
+
+	m_saved_checkpoint_state = checkpoint_state;
+	m_is_saved = true;
+
+	return true;
+}
+
+bool CCheckpoint::is_saved(const SCheckpointState &checkpoint_state) const
+{
+	return m_is_saved && checkpoint_state.log_segment == m_saved_checkpoint_state.log_segment &&
+		checkpoint_state.log_position == m_saved_checkpoint_state.log_position &&
+		checkpoint_state.pending_duration == m_saved_checkpoint_state.pending_duration && checkpoint_state.app_path == m_saved_checkpoint_state.app_path;
+}
\ No newline at end of file
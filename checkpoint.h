@@ -0,0 +1,40 @@
+//
+//
+
+#pragma once
+
+#define INPUT_MONITOR_CHECKPOINT_INTERVAL	2 * 1000
+
+#define INPUT_MONITOR_CHECKPOINT_MAGIC		0x50434941 // 'AICP'
+#define INPUT_MONITOR_CHECKPOINT_VERSION	2
+
+// Accounting state that has to survive a restart of the monitor
+struct SCheckpointState
+{
+	uint32_t log_segment; // Log segment that was open when this state was captured
+	uint64_t log_position; // Size of that segment when this state was captured
+	uint64_t pending_duration; // Input duration not yet written to the log, including the span that was open when this state was captured
+	std::wstring app_path; // Recently used app
+};
+
+class CCheckpoint
+{
+public:
+	CCheckpoint();
+	~CCheckpoint();
+
+	bool init(const wchar_t *file_name);
+
+	bool save(const SCheckpointState &checkpoint_state);
+	bool load(SCheckpointState &checkpoint_state);
+
+private:
+	bool is_saved(const SCheckpointState &checkpoint_state) const;
+
+	std::wstring m_file_name;
+	std::wstring m_temp_file_name;
+
+	// What the checkpoint file holds, so that an unchanged state isn't flushed to the disk again
+	SCheckpointState m_saved_checkpoint_state;
+	bool m_is_saved;
+};
\ No newline at end of file
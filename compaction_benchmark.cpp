@@ -0,0 +1,137 @@
+//
+//
+
+#include "stdafx.h"
+
+#include "log_index.h"
+#include "file_writer.h"
+#include "log_compactor.h"
+#include "compaction_benchmark.h"
+
+namespace
+{
+	constexpr uint64_t benchmark_record_interval = 10 * 1000; // The monitor writes a record for the app in use every time its timer fires
+
+	constexpr uint32_t benchmark_switch_percent = 10; // Percentage of records written for another app than the one before
+}
+
+CCompactionBenchmark::CCompactionBenchmark()
+{
+
+}
+
+CCompactionBenchmark::~CCompactionBenchmark()
+{
+
+}
+
+SCompactionBenchmarkResult CCompactionBenchmark::run(uint64_t record_count, uint32_t app_count, uint64_t segment_size)
+{
+	SCompactionBenchmarkResult benchmark_result = {};
+	if (!create_directory())
+	{
+		return benchmark_result;
+	}
+
+	std::wstring file_prefix = m_directory + L"app_input_data";
+
+	CLogIndex log_index;
+	log_index.init((file_prefix + L".index").data());
+
+	// The records end now and reach back as far as the timer would have taken to write them, so they spread over several per-day files
+	// that are all within the retention window
+	{
+		CFileWriter file_writer;
+		if (!file_writer.init(file_prefix.data(), &log_index, 0, segment_size, UINT64_MAX))
+		{
+			remove_directory(log_index);
+			return benchmark_result;
+		}
+
+		std::mt19937 random_generator(1);
+		uint64_t record_time = CHRONO_SYSTEM_TIME_SINCE_EPOCH_COUNT -
+			record_count * benchmark_record_interval;
+		uint32_t app_index = 0;
+		for (uint64_t record_index = 0; record_index < record_count; record_index++)
+		{
+			if (random_generator() % 100 < benchmark_switch_percent)
+			{
+				app_index = random_generator() % app_count;
+			}
+
+			std::wstring json_buffer = L"{\n\n\t \"app_name\" : \"C:\\Program Files\\app " + std::to_wstring(app_index) + L"\\app.exe\",\n\t \"duration\" : " +
+				std::to_wstring(random_generator() % benchmark_record_interval) + L",\n\t \"time\" : " + std::to_wstring(record_time) + L"\n}\n";
+			file_writer.write_data(json_buffer.data(), record_time);
+
+			record_time += benchmark_record_interval;
+		}
+
+		file_writer.close();
+		log_index.close_segment(file_writer.get_segment_number());
+	}
+
+	uint64_t segment_count = 0;
+	for (const auto &index_entry : log_index.get_entries())
+	{
+		if (index_entry.entry_type == ELogIndexEntryType::segment)
+		{
+			segment_count++;
+		}
+	}
+
+	// Compact on the background thread of the compactor, exactly as the monitor does
+	auto start_time = std::chrono::steady_clock::now();
+	{
+		CLogCompactor log_compactor;
+		log_compactor.init(file_prefix.data(), &log_index);
+
+		while (log_compactor.get_statistics().compacted_segments < segment_count &&
+			std::chrono::steady_clock::now() - start_time < std::chrono::milliseconds(COMPACTION_BENCHMARK_TIMEOUT))
+		{
+			std::this_thread::sleep_for(std::chrono::milliseconds(10));
+		}
+
+		log_compactor.close();
+		benchmark_result.compaction_statistics = log_compactor.get_statistics();
+	}
+	auto elapsed_time = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start_time).count();
+
+	const SCompactionStatistics &compaction_statistics = benchmark_result.compaction_statistics;
+	benchmark_result.records_per_second = compaction_statistics.compaction_time ? compaction_statistics.records_read * 1000000 / compaction_statistics.compaction_time : 0;
+	benchmark_result.bytes_per_second = compaction_statistics.compaction_time ? compaction_statistics.bytes_read * 1000000 / compaction_statistics.compaction_time : 0;
+	benchmark_result.space_saving = compaction_statistics.bytes_read > compaction_statistics.bytes_written ?
+		(compaction_statistics.bytes_read - compaction_statistics.bytes_written) * 100 / compaction_statistics.bytes_read : 0;
+	benchmark_result.elapsed_time = static_cast<uint64_t>(elapsed_time);
+	benchmark_result.is_complete = compaction_statistics.compacted_segments == segment_count;
+
+	remove_directory(log_index);
+
+	return benchmark_result;
+}
+
+bool CCompactionBenchmark::create_directory()
+{
+	wchar_t temp_path[MAX_PATH] = { 0 };
+	if (!::GetTempPathW(MAX_PATH, temp_path))
+	{
+		return false;
+	}
+
+	m_directory = std::wstring(temp_path) + L"app_usage_compaction_benchmark_" + std::to_wstring(::GetCurrentProcessId()) + L"\\";
+
+	return ::CreateDirectoryW(m_directory.data(), nullptr) || ::GetLastError() == ERROR_ALREADY_EXISTS;
+}
+
+void CCompactionBenchmark::remove_directory(const CLogIndex &log_index)
+{
+	for (const auto &index_entry : log_index.get_entries())
+	{
+		::DeleteFileW(index_entry.file_name.data());
+	}
+
+	std::wstring index_file_name = m_directory + L"app_input_data.index";
+	::DeleteFileW(index_file_name.data());
+	::DeleteFileW((index_file_name + L".tmp").data());
+
+	::RemoveDirectoryW(m_directory.data());
+}
\ No newline at end of file
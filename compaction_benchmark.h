@@ -0,0 +1,39 @@
+//
+//
+
+#pragma once
+
+#define COMPACTION_BENCHMARK_RECORD_COUNT	200 * 1000 // Records written to the segments before they're compacted
+
+#define COMPACTION_BENCHMARK_APP_COUNT		40
+
+#define COMPACTION_BENCHMARK_SEGMENT_SIZE	256 * 1024 // Smaller than the default so the records spread over many segments, in bytes
+
+#define COMPACTION_BENCHMARK_TIMEOUT		5 * 60 * 1000 // Milliseconds
+
+struct SCompactionBenchmarkResult
+{
+	SCompactionStatistics compaction_statistics;
+	uint64_t records_per_second, bytes_per_second; // Throughput of the compaction itself, measured over the time spent compacting
+	uint64_t space_saving; // Percentage of the segment bytes the per-day files don't need
+	uint64_t elapsed_time; // Milliseconds from the first segment being compacted to the last, at background priority
+	bool is_complete; // Every segment was compacted before the timeout
+};
+
+// Writes a log of synthetic app usage records through CFileWriter into a temporary directory, lets CLogCompactor merge the segments on
+// its background thread as it would in the monitor, and reports the throughput of the compaction and the space it saved
+class CCompactionBenchmark
+{
+public:
+	CCompactionBenchmark();
+	~CCompactionBenchmark();
+
+	SCompactionBenchmarkResult run(uint64_t record_count = COMPACTION_BENCHMARK_RECORD_COUNT, uint32_t app_count = COMPACTION_BENCHMARK_APP_COUNT,
+		uint64_t segment_size = COMPACTION_BENCHMARK_SEGMENT_SIZE);
+
+private:
+	bool create_directory();
+	void remove_directory(const CLogIndex &log_index);
+
+	std::wstring m_directory;
+};
\ No newline at end of file
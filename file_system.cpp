@@ -0,0 +1,207 @@
+//
+//
+
+#include "stdafx.h"
+
+#include "file_system.h"
+
+#ifdef _WIN32
+CFileSystem::stream_name CFileSystem::get_stream_name(const std::wstring &file_name)
+{
+	return file_name;
+}
+
+std::vector<std::wstring> CFileSystem::find_files(const std::wstring &file_pattern)
+{
+	std::vector<std::wstring> file_names;
+
+	WIN32_FIND_DATAW find_data = { 0 };
+	HANDLE find_handle = ::FindFirstFileW(file_pattern.data(), &find_data);
+	if (find_handle == INVALID_HANDLE_VALUE)
+	{
+		return file_names;
+	}
+
+	// The search only returns file names, without the directory the pattern may start with
+	const std::wstring directory = file_pattern.substr(0, file_pattern.find_last_of(L"\\/") + 1);
+	do
+	{
+		file_names.push_back(directory + find_data.cFileName);
+	} while (::FindNextFileW(find_handle, &find_data));
+
+	::FindClose(find_handle);
+
+	return file_names;
+}
+
+bool CFileSystem::get_file_size(const std::wstring &file_name, uint64_t &file_size)
+{
+	WIN32_FILE_ATTRIBUTE_DATA file_attribute_data = { 0 };
+	if (!::GetFileAttributesExW(file_name.data(), GetFileExInfoStandard, &file_attribute_data))
+	{
+		return false;
+	}
+
+	file_size = (static_cast<uint64_t>(file_attribute_data.nFileSizeHigh) << 32) | file_attribute_data.nFileSizeLow;
+
+	return true;
+}
+
+bool CFileSystem::read_file(const std::wstring &file_name, std::vector<byte> &file_data)
+{
+	uint64_t file_size = 0;
+	if (!get_file_size(file_name, file_size) || file_size > UINT32_MAX)
+	{
+		return false;
+	}
+
+	HANDLE file_handle = ::CreateFileW(file_name.data(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (file_handle == INVALID_HANDLE_VALUE)
+	{
+		return false;
+	}
+
+	file_data.resize(static_cast<size_t>(file_size));
+
+	DWORD bytes_read = 0;
+	bool is_read = ::ReadFile(file_handle, file_data.data(), static_cast<DWORD>(file_data.size()), &bytes_read, nullptr) && bytes_read == file_data.size();
+	::CloseHandle(file_handle);
+
+	return is_read;
+}
+
+bool CFileSystem::write_file(const std::wstring &file_name, const std::vector<byte> &file_data)
+{
+	HANDLE file_handle = ::CreateFileW(file_name.data(), GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (file_handle == INVALID_HANDLE_VALUE)
+	{
+		return false;
+	}
+
+	DWORD bytes_written = 0;
+	bool is_written = ::WriteFile(file_handle, file_data.data(), static_cast<DWORD>(file_data.size()), &bytes_written, nullptr) &&
+		bytes_written == file_data.size() && ::FlushFileBuffers(file_handle);
+	::CloseHandle(file_handle);
+
+	if (!is_written)
+	{
+		::DeleteFileW(file_name.data());
+	}
+
+	return is_written;
+}
+
+bool CFileSystem::replace_file(const std::wstring &source_file_name, const std::wstring &target_file_name)
+{
+	return ::MoveFileExW(source_file_name.data(), target_file_name.data(), MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH) != FALSE;
+}
+
+bool CFileSystem::delete_file(const std::wstring &file_name)
+{
+	return ::DeleteFileW(file_name.data()) != FALSE;
+}
+#else
+CFileSystem::stream_name CFileSystem::get_stream_name(const std::wstring &file_name)
+{
+	std::string narrow_file_name;
+	for (const auto &name_character : file_name)
+	{
+		narrow_file_name += static_cast<char>(name_character);
+	}
+
+	return narrow_file_name;
+}
+
+std::vector<std::wstring> CFileSystem::find_files(const std::wstring &file_pattern)
+{
+	std::vector<std::wstring> file_names;
+
+	const std::wstring directory = file_pattern.substr(0, file_pattern.find_last_of(L'/') + 1);
+	const std::string name_pattern = get_stream_name(file_pattern.substr(directory.size()));
+
+	DIR *directory_stream = ::opendir(directory.empty() ? "." : get_stream_name(directory).data());
+	if (!directory_stream)
+	{
+		return file_names;
+	}
+
+	while (dirent *directory_entry = ::readdir(directory_stream))
+	{
+		if (::fnmatch(name_pattern.data(), directory_entry->d_name, FNM_PERIOD) == 0)
+		{
+			std::string file_name = directory_entry->d_name;
+			file_names.push_back(directory + std::wstring(file_name.begin(), file_name.end()));
+		}
+	}
+
+	::closedir(directory_stream);
+
+	return file_names;
+}
+
+bool CFileSystem::get_file_size(const std::wstring &file_name, uint64_t &file_size)
+{
+	struct stat file_status = {};
+	if (::stat(get_stream_name(file_name).data(), &file_status) == -1)
+	{
+		return false;
+	}
+
+	file_size = static_cast<uint64_t>(file_status.st_size);
+
+	return true;
+}
+
+bool CFileSystem::read_file(const std::wstring &file_name, std::vector<byte> &file_data)
+{
+	std::ifstream input_file(get_stream_name(file_name).data(), std::ios::binary);
+	if (!input_file.is_open())
+	{
+		return false;
+	}
+
+	file_data.assign(std::istreambuf_iterator<char>(input_file), std::istreambuf_iterator<char>());
+
+	return !input_file.bad();
+}
+
+bool CFileSystem::write_file(const std::wstring &file_name, const std::vector<byte> &file_data)
+{
+	int file_descriptor = ::open(get_stream_name(file_name).data(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (file_descriptor == -1)
+	{
+		return false;
+	}
+
+	size_t written_size = 0;
+	while (written_size < file_data.size())
+	{
+		ssize_t chunk_size = ::write(file_descriptor, file_data.data() + written_size, file_data.size() - written_size);
+		if (chunk_size <= 0)
+		{
+			break;
+		}
+		written_size += static_cast<size_t>(chunk_size);
+	}
+
+	bool is_written = written_size == file_data.size() && ::fsync(file_descriptor) == 0;
+	::close(file_descriptor);
+
+	if (!is_written)
+	{
+		::unlink(get_stream_name(file_name).data());
+	}
+
+	return is_written;
+}
+
+bool CFileSystem::replace_file(const std::wstring &source_file_name, const std::wstring &target_file_name)
+{
+	return ::rename(get_stream_name(source_file_name).data(), get_stream_name(target_file_name).data()) == 0;
+}
+
+bool CFileSystem::delete_file(const std::wstring &file_name)
+{
+	return ::unlink(get_stream_name(file_name).data()) == 0;
+}
+#endif // _WIN32
\ No newline at end of file
@@ -0,0 +1,26 @@
+//
+//
+
+#pragma once
+
+// The file operations the log and the checkpoint are built on. On Windows they're the wide Win32 file functions, elsewhere POSIX with the
+// wide names narrowed to ASCII, which is all the monitor names its files with.
+class CFileSystem
+{
+public:
+#ifdef _WIN32
+	typedef std::wstring stream_name; // MSVC opens file streams with wide names
+#else
+	typedef std::string stream_name;
+#endif // _WIN32
+
+	static stream_name get_stream_name(const std::wstring &file_name);
+
+	static std::vector<std::wstring> find_files(const std::wstring &file_pattern); // The wildcards may only be in the file name
+	static bool get_file_size(const std::wstring &file_name, uint64_t &file_size);
+
+	static bool read_file(const std::wstring &file_name, std::vector<byte> &file_data);
+	static bool write_file(const std::wstring &file_name, const std::vector<byte> &file_data); // Only returns once the data is on disk
+	static bool replace_file(const std::wstring &source_file_name, const std::wstring &target_file_name); // Readers see one or the other
+	static bool delete_file(const std::wstring &file_name);
+};
\ No newline at end of file
@@ -3,11 +3,21 @@
 
 #include "stdafx.h"
 
+#include "file_system.h"
+#include "log_index.h"
+#include "log_compactor.h"
+#include "trace_recorder.h"
 #include "file_writer.h"
 
 CFileWriter::CFileWriter()
 {
+	m_log_index = nullptr;
 
+	m_segment_number = 0;
+	m_segment_size = m_segment_open_time = 0;
+
+	m_segment_max_size = LOG_SEGMENT_MAX_SIZE;
+	m_segment_max_age = LOG_SEGMENT_MAX_AGE;
 }
 
 CFileWriter::~CFileWriter()
@@ -15,15 +25,61 @@ CFileWriter::~CFileWriter()
 
 }
 
-bool CFileWriter::init(const wchar_t *file_name)
+bool CFileWriter::init(const wchar_t *file_prefix, CLogIndex *log_index, uint32_t compacted_through_segment, uint64_t segment_max_size, uint64_t segment_max_age)
 {
-	m_app_input_data = std::wofstream(file_name, std::ios::trunc);
-	if (!m_app_input_data.is_open())
+	m_file_prefix = file_prefix;
+	m_log_index = log_index;
+
+	m_segment_max_size = segment_max_size;
+	m_segment_max_age = segment_max_age;
+
+	// Numbering continues after the highest segment that was ever written, the index alone isn't enough for that. Were it lost or
+	// unreadable, numbering would restart at 1 and the compactor would take the new segments for ones already merged into a day file.
+	std::vector<SLogIndexEntry> index_entries = m_log_index->get_entries();
+	uint32_t last_segment_number = compacted_through_segment;
+	bool is_last_segment_open = false;
+	for (const auto &index_entry : index_entries)
 	{
-		return false;
+		if (index_entry.entry_type == ELogIndexEntryType::segment && index_entry.segment_number > last_segment_number)
+		{
+			last_segment_number = index_entry.segment_number;
+			is_last_segment_open = !index_entry.is_closed;
+		}
 	}
 
-	return true;
+	// Segments the index doesn't know about are listed as closed so that the compactor still merges them
+	for (uint32_t segment_number : find_segment_numbers(m_file_prefix))
+	{
+		auto index_entry_iterator = std::find_if(index_entries.begin(), index_entries.end(), [segment_number](const SLogIndexEntry &index_entry)
+			{ return index_entry.entry_type == ELogIndexEntryType::segment && index_entry.segment_number == segment_number; });
+		if (index_entry_iterator != index_entries.end())
+		{
+			continue;
+		}
+
+		SLogIndexEntry index_entry = {};
+		index_entry.entry_type = ELogIndexEntryType::segment;
+		index_entry.segment_number = segment_number;
+		index_entry.file_name = get_segment_file_name(m_file_prefix, segment_number);
+		index_entry.is_closed = true;
+		m_log_index->add_entry(index_entry);
+		index_time_range(index_entry.file_name);
+
+		if (segment_number > last_segment_number)
+		{
+			last_segment_number = segment_number;
+			is_last_segment_open = false;
+		}
+	}
+
+	// Keep the data written before the last restart by resuming the segment that was still open, a checkpoint is reconciled
+	// against the end of this segment
+	if (is_last_segment_open)
+	{
+		return open_segment(last_segment_number);
+	}
+
+	return open_segment(last_segment_number + 1);
 }
 
 void CFileWriter::close()
@@ -34,7 +90,150 @@ void CFileWriter::close()
 	}
 }
 
-void CFileWriter::write_data(const wchar_t *data_to_write)
+void CFileWriter::write_data(const wchar_t *data_to_write, uint64_t record_time)
 {
+	TRACE_SCOPE("CFileWriter::write_data");
+
+	if (!m_app_input_data.is_open())
+	{
+		return;
+	}
+
+	// Roll the segment before writing so that a segment never exceeds its limits by more than one record
+	roll_segment_if_due();
+
 	m_app_input_data << data_to_write;
+	m_app_input_data.flush();
+
+	m_segment_size = static_cast<uint64_t>(m_app_input_data.tellp());
+
+	m_log_index->update_time_range(m_segment_file_name, record_time);
+}
+
+void CFileWriter::roll_segment_if_due()
+{
+	if (!m_app_input_data.is_open())
+	{
+		return;
+	}
+
+	uint64_t current_time = CHRONO_SYSTEM_TIME_SINCE_EPOCH_COUNT;
+	if (m_segment_size >= m_segment_max_size || current_time - m_segment_open_time >= m_segment_max_age)
+	{
+		roll_segment();
+	}
+}
+
+uint32_t CFileWriter::get_segment_number() const
+{
+	return m_segment_number;
+}
+
+uint64_t CFileWriter::get_segment_size() const
+{
+	return m_segment_size;
+}
+
+std::wstring CFileWriter::get_segment_file_name(const std::wstring &file_prefix, uint32_t segment_number)
+{
+	wchar_t segment_suffix[32] = { 0 };
+	swprintf_s(segment_suffix, L".%06u.json", segment_number);
+
+	return file_prefix + segment_suffix;
+}
+
+std::vector<uint32_t> CFileWriter::find_segment_numbers(const std::wstring &file_prefix)
+{
+	std::vector<uint32_t> segment_numbers;
+
+	const std::wstring file_name_prefix = file_prefix + L".";
+	const std::wstring file_name_suffix = L".json";
+	for (const auto &file_name : CFileSystem::find_files(file_prefix + L".*.json"))
+	{
+		// Segment numbers are all digits, which tells them apart from the dates of the per-day files
+		if (file_name.size() <= file_name_prefix.size() + file_name_suffix.size() || file_name.compare(0, file_name_prefix.size(), file_name_prefix) ||
+			file_name.compare(file_name.size() - file_name_suffix.size(), file_name_suffix.size(), file_name_suffix))
+		{
+			continue;
+		}
+
+		std::wstring segment_number = file_name.substr(file_name_prefix.size(), file_name.size() - file_name_prefix.size() - file_name_suffix.size());
+		if (std::all_of(segment_number.begin(), segment_number.end(), [](wchar_t character) { return character >= L'0' && character <= L'9'; }))
+		{
+			segment_numbers.push_back(static_cast<uint32_t>(std::wcstoul(segment_number.data(), nullptr, 10)));
+		}
+	}
+
+	return segment_numbers;
+}
+
+bool CFileWriter::open_segment(uint32_t segment_number)
+{
+	close();
+
+	m_segment_number = segment_number;
+	m_segment_file_name = get_segment_file_name(m_file_prefix, segment_number);
+	m_segment_open_time = CHRONO_SYSTEM_TIME_SINCE_EPOCH_COUNT;
+
+	m_app_input_data = std::wofstream(CFileSystem::get_stream_name(m_segment_file_name).data(), std::ios::app);
+	if (!m_app_input_data.is_open())
+	{
+		return false;
+	}
+
+	m_app_input_data.seekp(0, std::ios::end);
+	m_segment_size = static_cast<uint64_t>(m_app_input_data.tellp());
+
+	// A resumed segment is already listed in the index, but the range of its records was lost if the monitor didn't shut down cleanly
+	for (const auto &index_entry : m_log_index->get_entries())
+	{
+		if (index_entry.entry_type == ELogIndexEntryType::segment && index_entry.segment_number == segment_number)
+		{
+			index_time_range(m_segment_file_name);
+			return true;
+		}
+	}
+
+	SLogIndexEntry index_entry = {};
+	index_entry.entry_type = ELogIndexEntryType::segment;
+	index_entry.segment_number = segment_number;
+	index_entry.file_name = m_segment_file_name;
+	index_entry.is_closed = false;
+	m_log_index->add_entry(index_entry);
+
+	return true;
+}
+
+void CFileWriter::index_time_range(const std::wstring &segment_file_name)
+{
+	std::wifstream segment_file(CFileSystem::get_stream_name(segment_file_name).data());
+	if (!segment_file.is_open())
+	{
+		return;
+	}
+
+	std::vector<SAppUsageRecord> app_usage_records;
+	CLogCompactor::parse_records(std::wstring(std::istreambuf_iterator<wchar_t>(segment_file), std::istreambuf_iterator<wchar_t>()), app_usage_records);
+	if (app_usage_records.empty())
+	{
+		return;
+	}
+
+	uint64_t first_record_time = UINT64_MAX, last_record_time = 0;
+	for (const auto &app_usage_record : app_usage_records)
+	{
+		first_record_time = std::min(first_record_time, app_usage_record.record_time);
+		last_record_time = std::max(last_record_time, app_usage_record.record_time);
+	}
+	m_log_index->set_time_range(segment_file_name, first_record_time, last_record_time);
+}
+
+bool CFileWriter::roll_segment()
+{
+	uint32_t closed_segment_number = m_segment_number;
+
+	close();
+	m_log_index->close_segment(closed_segment_number);
+
+	return open_segment(closed_segment_number + 1);
 }
\ No newline at end of file
@@ -1,16 +1,46 @@
 #pragma once
 
+#define LOG_SEGMENT_MAX_SIZE	1024 * 1024 // Roll the segment once it grows past this many bytes
+
+#define LOG_SEGMENT_MAX_AGE		60 * 60 * 1000 // Roll the segment once it has been open for this many milliseconds
+
+class CLogIndex;
+
 class CFileWriter
 {
 public:
 	CFileWriter();
 	~CFileWriter();
 
-	bool init(const wchar_t *file_name);
+	bool init(const wchar_t *file_prefix, CLogIndex *log_index, uint32_t compacted_through_segment, uint64_t segment_max_size = LOG_SEGMENT_MAX_SIZE,
+		uint64_t segment_max_age = LOG_SEGMENT_MAX_AGE);
 	void close();
 
-	void write_data(const wchar_t *data_to_write);
+	void write_data(const wchar_t *data_to_write, uint64_t record_time);
+
+	void roll_segment_if_due(); // Lets a caller learn which segment the next write lands in before building it
+
+	uint32_t get_segment_number() const;
+	uint64_t get_segment_size() const;
+
+	static std::wstring get_segment_file_name(const std::wstring &file_prefix, uint32_t segment_number);
+	static std::vector<uint32_t> find_segment_numbers(const std::wstring &file_prefix); // Segments on disk, whether the index lists them or not
 
 private:
+	bool open_segment(uint32_t segment_number);
+	void index_time_range(const std::wstring &segment_file_name); // Rebuilds the time range of a segment written before a restart
+	bool roll_segment();
+
 	std::wofstream m_app_input_data;
+
+	std::wstring m_file_prefix;
+	std::wstring m_segment_file_name;
+
+	CLogIndex *m_log_index;
+
+	uint32_t m_segment_number;
+	uint64_t m_segment_size;
+	uint64_t m_segment_open_time;
+
+	uint64_t m_segment_max_size, m_segment_max_age;
 };
\ No newline at end of file
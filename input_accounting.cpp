@@ -0,0 +1,454 @@
+//
+//
+
+#include "stdafx.h"
+
+#include "checkpoint.h"
+#include "adaptive_sampling.h"
+#include "input_accounting.h"
+
+CInputAccounting::CInputAccounting()
+{
+	m_is_adaptive_sampling_enabled = false;
+
+	reset(0);
+}
+
+CInputAccounting::~CInputAccounting()
+{
+
+}
+
+void CInputAccounting::reset(uint64_t current_time)
+{
+	m_key_down_counter = 0;
+
+	m_keydown_virtual_keys.clear();
+	m_mouse_activity.clear();
+	m_duplicate_mouse_activity.clear();
+
+	m_input_hardware_start_time = 0;
+	m_accumulated_input_duration.clear();
+
+	m_last_input_time = m_last_pointer_input_time = 0;
+	m_accounting_start_time = current_time;
+	m_total_accumulated_time = m_missed_input_event_count = 0;
+
+	m_key_event_count = m_mouse_event_count = 0;
+
+	m_sampling_policy.reset();
+}
+
+void CInputAccounting::enable_adaptive_sampling(bool is_enabled)
+{
+	m_is_adaptive_sampling_enabled = is_enabled;
+}
+
+bool CInputAccounting::on_key_down(uint16_t virtual_key, uint64_t current_time)
+{
+	expire_pointer_activity(current_time);
+
+	m_last_input_time = current_time;
+	m_key_event_count++;
+
+	// A user could have continuously pressed one or more keys so let's filter it out here
+	if (std::find(m_keydown_virtual_keys.begin(), m_keydown_virtual_keys.end(), virtual_key) == m_keydown_virtual_keys.end())
+	{
+		// If nothing is active, let's assign the current time
+		if (is_keyboard_activity_inactive() && is_mouse_activity_inactive())
+		{
+			m_input_hardware_start_time = current_time;
+		}
+
+		// This key was not down before. The counter always mirrors the container so that it can't drift when a make or break is missed
+		m_keydown_virtual_keys.push_back(virtual_key);
+		m_key_down_counter = static_cast<int16_t>(m_keydown_virtual_keys.size());
+	}
+
+	// A held key has to be seen report by report, so a key press resumes full rate mouse input
+	return m_sampling_policy.on_held_input();
+}
+
+void CInputAccounting::on_key_up(uint16_t virtual_key, uint64_t current_time)
+{
+	expire_pointer_activity(current_time);
+
+	m_last_input_time = current_time;
+	m_key_event_count++;
+
+	// If a key was previously down, let's check and remove it from the container
+	if (std::find(m_keydown_virtual_keys.begin(), m_keydown_virtual_keys.end(), virtual_key) != m_keydown_virtual_keys.end())
+	{
+		m_keydown_virtual_keys.remove(virtual_key);
+		m_key_down_counter = static_cast<int16_t>(m_keydown_virtual_keys.size());
+
+		end_held_input(current_time);
+	}
+	else // The make for this key was never seen
+	{
+		m_missed_input_event_count++;
+	}
+}
+
+bool CInputAccounting::on_mouse_activated(uint16_t button_flag, uint64_t current_time)
+{
+	expire_pointer_activity(current_time);
+
+	m_last_input_time = current_time;
+	m_mouse_event_count++;
+
+	// Check to prevent insertion of button flag more than once from mouse and touchpad
+	if (std::find(m_mouse_activity.begin(), m_mouse_activity.end(), button_flag) == m_mouse_activity.end()) // This button hasn't been pressed
+	{
+		// Let's check if this is an initial input activity. If it is then we start tracking it's duration
+		if (is_mouse_activity_inactive() && is_keyboard_activity_inactive())
+		{
+			m_input_hardware_start_time = current_time;
+		}
+
+		m_mouse_activity.push_back(button_flag);
+	}
+	else // This button was already being pressed before so it could have been pressed again from either touchpad or mouse
+	{
+		// Insert this duplicate mouse button down data in a different container
+		m_duplicate_mouse_activity.push_back(button_flag);
+	}
+
+	return m_sampling_policy.on_held_input();
+}
+
+void CInputAccounting::on_mouse_deactivated(uint16_t button_flag, uint64_t current_time)
+{
+	expire_pointer_activity(current_time);
+
+	m_last_input_time = current_time;
+	m_mouse_event_count++;
+
+	// Check if this button flag is already present in the container
+	if (std::find(m_mouse_activity.begin(), m_mouse_activity.end(), button_flag) != m_mouse_activity.end()) // This button flag is present
+	{
+		// There could have been same mouse buttons down: button click from mouse and another button click from touchpad. So a user could
+		// have released one button while the other button is still down.
+		if (std::find(m_duplicate_mouse_activity.begin(), m_duplicate_mouse_activity.end(), button_flag) != m_duplicate_mouse_activity.end()) // Duplicate data exists
+		{
+			m_duplicate_mouse_activity.remove(button_flag);
+		}
+		else // No duplicate button down exists for this mouse button
+		{
+			m_mouse_activity.remove(button_flag);
+		}
+
+		end_held_input(current_time);
+	}
+	else // The button down for this button was never seen
+	{
+		m_missed_input_event_count++;
+	}
+}
+
+bool CInputAccounting::on_mouse_wheel_scroll(uint64_t current_time)
+{
+	return on_pointer_report(MOUSE_WHEEL_SCROLL_MESSAGE, current_time);
+}
+
+bool CInputAccounting::on_mouse_movement(uint64_t current_time)
+{
+	return on_pointer_report(MOUSE_CURSOR_MOVEMENT_MESSAGE, current_time);
+}
+
+bool CInputAccounting::on_input_probe(uint64_t current_time, uint64_t last_input_time, uint16_t held_button_flags)
+{
+	if (!m_sampling_policy.is_probing())
+	{
+		return false;
+	}
+
+	// Keys resume full rate input, so any input the probe sees while throttled comes from the mouse
+	if (last_input_time > m_last_input_time)
+	{
+		record_pointer_input(MOUSE_CURSOR_MOVEMENT_MESSAGE, last_input_time);
+	}
+
+	// Buttons aren't received while throttled. One that is held is counted from the last input, which is as early as it can have been
+	// pressed if the mouse has been still since, and full rate input resumes so that its release is received.
+	if (held_button_flags)
+	{
+		for (uint16_t button_flag = 1; button_flag; button_flag <<= 1)
+		{
+			if (held_button_flags & button_flag)
+			{
+				on_mouse_activated(button_flag, m_last_input_time);
+			}
+		}
+
+		return true;
+	}
+
+	if (m_sampling_policy.on_probe(current_time, m_last_input_time))
+	{
+		// The user went idle so the span ends at the last input, exactly where full rate input would have ended it
+		end_pointer_activity(m_last_pointer_input_time);
+		return true;
+	}
+
+	return false;
+}
+
+uint64_t CInputAccounting::collect_input_duration(uint64_t current_time)
+{
+	expire_pointer_activity(current_time);
+
+	accumulate_input_duration(get_span_end_time(current_time));
+
+	if (is_held_input_stale(current_time))
+	{
+		// A key or button release can be missed altogether, e.g. while the secure desktop owns the input, so keys and buttons that
+		// haven't seen any input for a whole interval are considered released at the time of the last input
+		m_missed_input_event_count += m_keydown_virtual_keys.size() + m_mouse_activity.size() + m_duplicate_mouse_activity.size();
+		m_keydown_virtual_keys.clear();
+		m_key_down_counter = 0;
+		m_mouse_activity.clear();
+		m_duplicate_mouse_activity.clear();
+	}
+
+	if (is_keyboard_activity_inactive() && is_mouse_activity_inactive())
+	{
+		m_input_hardware_start_time = 0;
+	}
+
+	// Let's accumulate the total duration elapsed from all the inputs
+	uint64_t total_duration = 0;
+	for (const auto &time_elapsed : m_accumulated_input_duration)
+	{
+		total_duration += time_elapsed;
+	}
+	m_accumulated_input_duration.clear();
+
+	return total_duration;
+}
+
+void CInputAccounting::save_checkpoint(SCheckpointState &checkpoint_state, uint64_t current_time) const
+{
+	checkpoint_state.pending_duration = 0;
+	for (const auto &time_elapsed : m_accumulated_input_duration)
+	{
+		checkpoint_state.pending_duration += time_elapsed;
+	}
+
+	// The open span up to where it's known to have lasted. A restart never sees the release of keys and buttons held now, so they're taken
+	// as released at the last input, the same as when their release is missed. Should the span still be open once the log is written next,
+	// the record covers this part of it as well and the checkpoint is discarded on restore.
+	uint64_t span_end_time = is_input_held() ? std::min(m_last_input_time, current_time) : get_span_end_time(current_time);
+	if (m_input_hardware_start_time != 0 && span_end_time > m_input_hardware_start_time)
+	{
+		checkpoint_state.pending_duration += span_end_time - m_input_hardware_start_time;
+	}
+}
+
+void CInputAccounting::restore_checkpoint(const SCheckpointState &checkpoint_state, uint32_t log_segment, uint64_t log_position)
+{
+	// Reconcile the checkpoint with the tail of the log. If the log grew or rolled over to another segment after the checkpoint was taken
+	// then the pending durations were already written as part of that record. Only when the log ends exactly where the checkpoint left it
+	// is the pending duration still unaccounted for.
+	if (checkpoint_state.pending_duration && checkpoint_state.log_segment == log_segment && checkpoint_state.log_position == log_position)
+	{
+		m_accumulated_input_duration.push_back(checkpoint_state.pending_duration);
+	}
+}
+
+bool CInputAccounting::check_invariants(uint64_t current_time) const
+{
+	// The key counter mirrors the keys that are down
+	if (m_key_down_counter < 0 || static_cast<size_t>(m_key_down_counter) != m_keydown_virtual_keys.size())
+	{
+		return false;
+	}
+
+	// A span can't start in the future and is open exactly while something is active
+	if (m_input_hardware_start_time > current_time || (m_input_hardware_start_time != 0) != (is_keyboard_activity_active() || is_mouse_activity_active()))
+	{
+		return false;
+	}
+
+	// Spans never overlap so all the input time accumulated since the start can't exceed the wall time elapsed since then
+	if (m_total_accumulated_time > current_time - m_accounting_start_time)
+	{
+		return false;
+	}
+
+	// Every duplicate button down needs the button to be down as well
+	for (const auto &button_flag : m_duplicate_mouse_activity)
+	{
+		if (std::find(m_mouse_activity.begin(), m_mouse_activity.end(), button_flag) == m_mouse_activity.end())
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+bool CInputAccounting::is_keyboard_activity_active() const
+{
+	return m_key_down_counter != 0;
+}
+
+bool CInputAccounting::is_keyboard_activity_inactive() const
+{
+	return m_key_down_counter == 0;
+}
+
+bool CInputAccounting::is_mouse_activity_active() const
+{
+	return !m_mouse_activity.empty();
+}
+
+bool CInputAccounting::is_mouse_activity_inactive() const
+{
+	return m_mouse_activity.empty();
+}
+
+bool CInputAccounting::is_probing() const
+{
+	return m_sampling_policy.is_probing();
+}
+
+uint64_t CInputAccounting::get_total_accumulated_time() const
+{
+	return m_total_accumulated_time;
+}
+
+uint64_t CInputAccounting::get_missed_input_event_count() const
+{
+	return m_missed_input_event_count;
+}
+
+uint64_t CInputAccounting::get_key_event_count() const
+{
+	return m_key_event_count;
+}
+
+uint64_t CInputAccounting::get_mouse_event_count() const
+{
+	return m_mouse_event_count;
+}
+
+bool CInputAccounting::on_pointer_report(uint16_t pointer_flag, uint64_t current_time)
+{
+	m_mouse_event_count++;
+
+	record_pointer_input(pointer_flag, current_time);
+
+	if (!m_is_adaptive_sampling_enabled)
+	{
+		return false;
+	}
+
+	// Throttling is only possible while nothing but the mouse movement or wheel is active, a held key or button has to be released
+	// report by report
+	return m_sampling_policy.on_mouse_report(current_time, is_keyboard_activity_inactive() && !is_input_held());
+}
+
+void CInputAccounting::record_pointer_input(uint16_t pointer_flag, uint64_t input_time)
+{
+	expire_pointer_activity(input_time);
+
+	m_last_input_time = m_last_pointer_input_time = input_time;
+
+	// Every report used to toggle the activity, which ended the span on every second report and dropped the time until the next one.
+	// Now the activity stays until its reports stop, the span is accumulated when it's collected or when the reports have stopped.
+	if (std::find(m_mouse_activity.begin(), m_mouse_activity.end(), pointer_flag) == m_mouse_activity.end())
+	{
+		// We only assign initial time when both keyboard and mouse data are inactive
+		if (is_keyboard_activity_inactive() && is_mouse_activity_inactive())
+		{
+			m_input_hardware_start_time = input_time;
+		}
+
+		m_mouse_activity.push_back(pointer_flag);
+	}
+}
+
+void CInputAccounting::expire_pointer_activity(uint64_t current_time)
+{
+	// While throttled the last report time is only as recent as the last probe, which only sees the most recent input and not a gap that
+	// ended between two probes, so only a probe that finds the user idle ends the activity
+	if (m_sampling_policy.is_probing())
+	{
+		return;
+	}
+
+	if (is_pointer_activity_active() && current_time - m_last_pointer_input_time >= INPUT_POINTER_IDLE_GAP)
+	{
+		end_pointer_activity(m_last_pointer_input_time);
+	}
+}
+
+void CInputAccounting::end_pointer_activity(uint64_t end_time)
+{
+	m_mouse_activity.remove(MOUSE_WHEEL_SCROLL_MESSAGE);
+	m_mouse_activity.remove(MOUSE_CURSOR_MOVEMENT_MESSAGE);
+
+	accumulate_input_duration(end_time);
+	if (is_keyboard_activity_inactive() && is_mouse_activity_inactive())
+	{
+		m_input_hardware_start_time = 0;
+	}
+}
+
+void CInputAccounting::end_held_input(uint64_t end_time)
+{
+	// The span is accumulated up to the release even if the wheel or movement keeps it open, as that only lasts until its last report
+	accumulate_input_duration(end_time);
+	if (is_keyboard_activity_inactive() && is_mouse_activity_inactive())
+	{
+		m_input_hardware_start_time = 0;
+	}
+}
+
+bool CInputAccounting::is_input_held() const
+{
+	if (is_keyboard_activity_active())
+	{
+		return true;
+	}
+
+	return std::any_of(m_mouse_activity.begin(), m_mouse_activity.end(),
+		[](uint16_t mouse_activity) { return mouse_activity != MOUSE_WHEEL_SCROLL_MESSAGE && mouse_activity != MOUSE_CURSOR_MOVEMENT_MESSAGE; });
+}
+
+bool CInputAccounting::is_held_input_stale(uint64_t current_time) const
+{
+	return is_input_held() && current_time - m_last_input_time >= INPUT_MONITOR_RESET_THRESHOLD;
+}
+
+bool CInputAccounting::is_pointer_activity_active() const
+{
+	return std::any_of(m_mouse_activity.begin(), m_mouse_activity.end(),
+		[](uint16_t mouse_activity) { return mouse_activity == MOUSE_WHEEL_SCROLL_MESSAGE || mouse_activity == MOUSE_CURSOR_MOVEMENT_MESSAGE; });
+}
+
+uint64_t CInputAccounting::get_span_end_time(uint64_t current_time) const
+{
+	// Held keys and buttons keep the span open until now, unless their release was missed. Otherwise only the wheel or the movement is
+	// active, which only lasts until its last report.
+	if (is_input_held())
+	{
+		return is_held_input_stale(current_time) ? m_last_input_time : current_time;
+	}
+
+	return m_last_pointer_input_time;
+}
+
+void CInputAccounting::accumulate_input_duration(uint64_t current_time)
+{
+	// Only the time elapsed since the span was last accumulated is added and the span then continues from there, so a span that is
+	// accumulated more than once is never counted twice
+	if (m_input_hardware_start_time != 0 && current_time > m_input_hardware_start_time)
+	{
+		m_accumulated_input_duration.push_back(current_time - m_input_hardware_start_time);
+		m_total_accumulated_time += current_time - m_input_hardware_start_time;
+
+		m_input_hardware_start_time = current_time;
+	}
+}
\ No newline at end of file
@@ -0,0 +1,93 @@
+//
+//
+
+#pragma once
+
+#define INPUT_MONITOR_RESET_THRESHOLD	10 * 1000 // Keys and buttons without any input for this long are considered released, in milliseconds
+
+#define INPUT_POINTER_IDLE_GAP			1000 // Wheel and movement reports further apart than this end the span, in milliseconds
+
+#define MOUSE_WHEEL_SCROLL_MESSAGE		0x0400 // Same value as RI_MOUSE_WHEEL
+
+#define MOUSE_CURSOR_MOVEMENT_MESSAGE	3000
+
+// Turns key, button, wheel and movement input into input durations. A span starts with the first input while nothing is active and ends
+// once nothing is: keys and buttons are active from their press to their release, while wheel and movement reports keep the span open
+// until no report has arrived for INPUT_POINTER_IDLE_GAP, in which case the span ends at the last report.
+//
+// Every time is passed in by the caller, in milliseconds, so the accounting has no platform dependencies and can be driven by a simulated
+// clock or replayed against recorded input on any platform. It isn't thread safe, CRawInput serializes the calls.
+class CInputAccounting
+{
+public:
+	CInputAccounting();
+	~CInputAccounting();
+
+	void reset(uint64_t current_time);
+
+	void enable_adaptive_sampling(bool is_enabled);
+
+	// The input handlers that can change the sampling mode return true when they did
+	bool on_key_down(uint16_t virtual_key, uint64_t current_time);
+	void on_key_up(uint16_t virtual_key, uint64_t current_time);
+	bool on_mouse_activated(uint16_t button_flag, uint64_t current_time);
+	void on_mouse_deactivated(uint16_t button_flag, uint64_t current_time);
+	bool on_mouse_wheel_scroll(uint64_t current_time);
+	bool on_mouse_movement(uint64_t current_time);
+	bool on_input_probe(uint64_t current_time, uint64_t last_input_time, uint16_t held_button_flags); // The flags of the buttons down right now
+
+	// Takes the input duration accumulated since the last call, it's written for the app that was in use until now
+	uint64_t collect_input_duration(uint64_t current_time);
+
+	// The pending duration includes the open span up to now, so time in a span that is still open when the monitor stops isn't lost
+	void save_checkpoint(SCheckpointState &checkpoint_state, uint64_t current_time) const;
+	void restore_checkpoint(const SCheckpointState &checkpoint_state, uint32_t log_segment, uint64_t log_position);
+
+	bool check_invariants(uint64_t current_time) const;
+
+	bool is_keyboard_activity_active() const;
+	bool is_keyboard_activity_inactive() const;
+	bool is_mouse_activity_active() const;
+	bool is_mouse_activity_inactive() const;
+
+	bool is_probing() const;
+
+	uint64_t get_total_accumulated_time() const;
+	uint64_t get_missed_input_event_count() const;
+	uint64_t get_key_event_count() const;
+	uint64_t get_mouse_event_count() const;
+
+private:
+	bool on_pointer_report(uint16_t pointer_flag, uint64_t current_time);
+	void record_pointer_input(uint16_t pointer_flag, uint64_t input_time);
+	void expire_pointer_activity(uint64_t current_time);
+	void end_pointer_activity(uint64_t end_time);
+	void end_held_input(uint64_t end_time);
+
+	bool is_input_held() const;
+	bool is_held_input_stale(uint64_t current_time) const;
+	bool is_pointer_activity_active() const;
+
+	uint64_t get_span_end_time(uint64_t current_time) const;
+
+	void accumulate_input_duration(uint64_t current_time);
+
+	int16_t m_key_down_counter;
+
+	std::list<uint16_t> m_keydown_virtual_keys;
+	std::list<uint16_t> m_mouse_activity; // Held buttons as well as the wheel and movement while their reports keep coming
+	std::list<uint16_t> m_duplicate_mouse_activity;
+
+	uint64_t m_input_hardware_start_time; // Start of the open span, zero while there's none
+	std::list<uint64_t> m_accumulated_input_duration;
+
+	uint64_t m_last_input_time; // Time of the most recent key or mouse input
+	uint64_t m_last_pointer_input_time; // Time of the most recent wheel or movement report
+	uint64_t m_accounting_start_time, m_total_accumulated_time; // Used to check that the accumulated time never exceeds the wall time
+	uint64_t m_missed_input_event_count; // Releases without a matching press and presses whose release never arrived
+
+	uint64_t m_key_event_count, m_mouse_event_count;
+
+	bool m_is_adaptive_sampling_enabled;
+	CAdaptiveSamplingPolicy m_sampling_policy;
+};
\ No newline at end of file
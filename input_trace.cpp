@@ -0,0 +1,67 @@
+//
+//
+
+#include "stdafx.h"
+
+#include "input_trace.h"
+
+namespace
+{
+	const char *trace_event_names[] = { "kd", "ku", "bd", "bu", "w", "m" }; // In the order of EInputTraceEvent
+}
+
+bool CInputTrace::load(std::istream &trace_stream, std::vector<SInputTraceEvent> &trace_events)
+{
+	uint64_t event_time = 0;
+
+	std::string trace_line;
+	while (std::getline(trace_stream, trace_line))
+	{
+		if (trace_line.empty() || trace_line[0] == '#')
+		{
+			continue;
+		}
+
+		std::istringstream line_stream(trace_line);
+
+		uint64_t elapsed_time = 0;
+		std::string event_name;
+		if (!(line_stream >> elapsed_time >> event_name))
+		{
+			return false;
+		}
+
+		auto event_name_iterator = std::find_if(std::begin(trace_event_names), std::end(trace_event_names),
+			[&event_name](const char *trace_event_name) { return event_name == trace_event_name; });
+		if (event_name_iterator == std::end(trace_event_names))
+		{
+			return false;
+		}
+
+		SInputTraceEvent trace_event = {};
+		event_time += elapsed_time;
+		trace_event.event_time = event_time;
+		trace_event.trace_event = static_cast<EInputTraceEvent>(event_name_iterator - std::begin(trace_event_names));
+
+		// Only keys and buttons carry a code
+		uint32_t input_code = 0;
+		if (line_stream >> std::hex >> input_code)
+		{
+			trace_event.input_code = static_cast<uint16_t>(input_code);
+		}
+
+		trace_events.push_back(trace_event);
+	}
+
+	return true;
+}
+
+void CInputTrace::write(std::ostream &trace_stream, const SInputTraceEvent &trace_event, uint64_t previous_event_time)
+{
+	trace_stream << trace_event.event_time - previous_event_time << ' ' << trace_event_names[static_cast<size_t>(trace_event.trace_event)];
+	if (trace_event.input_code)
+	{
+		trace_stream << ' ' << std::hex << trace_event.input_code << std::dec;
+	}
+	trace_stream << '\n';
+}
\ No newline at end of file
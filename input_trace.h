@@ -0,0 +1,32 @@
+//
+//
+
+#pragma once
+
+#define INPUT_TRACE_FILE_NAME	L"app_input_trace.txt"
+
+enum class EInputTraceEvent
+{
+	key_down,
+	key_up,
+	button_down,
+	button_up,
+	mouse_wheel,
+	mouse_movement,
+};
+
+struct SInputTraceEvent
+{
+	uint64_t event_time; // Milliseconds
+	EInputTraceEvent trace_event;
+	uint16_t input_code; // Virtual key or button flag, zero for the wheel and the movement
+};
+
+// Raw input as the monitor received it, one event per line: the milliseconds since the previous event, the event and the key or button
+// it's for. The monitor records a trace with /record_input and the sampling policy is replayed against it on any platform.
+class CInputTrace
+{
+public:
+	static bool load(std::istream &trace_stream, std::vector<SInputTraceEvent> &trace_events);
+	static void write(std::ostream &trace_stream, const SInputTraceEvent &trace_event, uint64_t previous_event_time);
+};
\ No newline at end of file
@@ -0,0 +1,110 @@
+//
+//
+
+#include "stdafx.h"
+
+#include "shared_memory.h"
+#include "live_stats.h"
+
+CLiveStatsPublisher::CLiveStatsPublisher()
+{
+	m_live_stats_region = nullptr;
+}
+
+CLiveStatsPublisher::~CLiveStatsPublisher()
+{
+	close();
+}
+
+bool CLiveStatsPublisher::init(const wchar_t *mapping_name)
+{
+	if (!m_shared_memory.create(mapping_name, sizeof(SLiveStatsRegion)))
+	{
+		return false;
+	}
+
+	m_live_stats_region = static_cast<SLiveStatsRegion *>(m_shared_memory.get_address());
+
+	return true;
+}
+
+void CLiveStatsPublisher::close()
+{
+	m_live_stats_region = nullptr;
+	m_shared_memory.close();
+}
+
+void CLiveStatsPublisher::publish(const SLiveStatsSnapshot &live_stats_snapshot)
+{
+	if (!m_live_stats_region)
+	{
+		return;
+	}
+
+	// There is a single writer so the sequence can't change under us
+	uint32_t sequence = m_live_stats_region->sequence.load(std::memory_order_relaxed);
+
+	m_live_stats_region->sequence.store(sequence + 1, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+
+	memcpy(&m_live_stats_region->snapshot, &live_stats_snapshot, sizeof(SLiveStatsSnapshot));
+
+	m_live_stats_region->sequence.store(sequence + 2, std::memory_order_release);
+}
+
+CLiveStatsReader::CLiveStatsReader()
+{
+	m_live_stats_region = nullptr;
+}
+
+CLiveStatsReader::~CLiveStatsReader()
+{
+	close();
+}
+
+bool CLiveStatsReader::init(const wchar_t *mapping_name)
+{
+	if (!m_shared_memory.open(mapping_name, sizeof(SLiveStatsRegion), false))
+	{
+		return false;
+	}
+
+	m_live_stats_region = static_cast<const SLiveStatsRegion *>(m_shared_memory.get_address());
+
+	return true;
+}
+
+void CLiveStatsReader::close()
+{
+	m_live_stats_region = nullptr;
+	m_shared_memory.close();
+}
+
+bool CLiveStatsReader::read(SLiveStatsSnapshot &live_stats_snapshot) const
+{
+	if (!m_live_stats_region)
+	{
+		return false;
+	}
+
+	for (uint32_t retry_count = 0; retry_count < LIVE_STATS_READ_RETRY_COUNT; retry_count++)
+	{
+		uint32_t start_sequence = m_live_stats_region->sequence.load(std::memory_order_acquire);
+		if (start_sequence & 1) // The writer is updating the snapshot
+		{
+			YieldProcessor();
+			continue;
+		}
+
+		memcpy(&live_stats_snapshot, &m_live_stats_region->snapshot, sizeof(SLiveStatsSnapshot));
+
+		std::atomic_thread_fence(std::memory_order_acquire);
+		if (m_live_stats_region->sequence.load(std::memory_order_relaxed) == start_sequence)
+		{
+			// Nothing has been published yet
+			return live_stats_snapshot.version == LIVE_STATS_VERSION;
+		}
+	}
+
+	return false;
+}
\ No newline at end of file
@@ -0,0 +1,85 @@
+//
+//
+
+#pragma once
+
+#define LIVE_STATS_MAPPING_NAME			L"Local\\AppInputMonitorLiveStats"
+
+#define LIVE_STATS_VERSION				1
+
+#define LIVE_STATS_MAX_APPS				64 // Apps used today beyond this many are not published
+
+#define LIVE_STATS_PUBLISH_INTERVAL		1000 // Milliseconds
+
+#define LIVE_STATS_READ_RETRY_COUNT		1000 // A reader gives up after the writer raced it this many times in a row
+
+struct SLiveStatsApp
+{
+	wchar_t app_path[MAX_PATH];
+	uint64_t duration_today; // Milliseconds
+};
+
+// Fixed layout shared with readers in other processes, only ever add fields at the end and bump the version
+struct SLiveStatsSnapshot
+{
+	uint32_t version;
+	uint32_t app_count;
+	uint64_t update_time; // Milliseconds since the UNIX epoch
+
+	wchar_t current_app_path[MAX_PATH];
+
+	// Event rates over the last publish interval
+	uint64_t key_events_per_second;
+	uint64_t mouse_events_per_second;
+
+	// Health counters since the monitor started
+	uint64_t key_event_count;
+	uint64_t mouse_event_count;
+	uint64_t missed_input_event_count;
+	uint64_t written_record_count;
+	uint64_t checkpoint_failure_count;
+	uint64_t log_segment_number;
+
+	SLiveStatsApp apps[LIVE_STATS_MAX_APPS];
+};
+
+// The sequence is odd while the writer is updating the snapshot. A reader copies the snapshot and only keeps the copy if the sequence
+// was even and unchanged around it, so readers never take a lock or make a system call and can't slow the writer down.
+struct SLiveStatsRegion
+{
+	std::atomic<uint32_t> sequence;
+	uint32_t reserved;
+	SLiveStatsSnapshot snapshot;
+};
+
+class CLiveStatsPublisher
+{
+public:
+	CLiveStatsPublisher();
+	~CLiveStatsPublisher();
+
+	bool init(const wchar_t *mapping_name = LIVE_STATS_MAPPING_NAME);
+	void close();
+
+	void publish(const SLiveStatsSnapshot &live_stats_snapshot);
+
+private:
+	CSharedMemory m_shared_memory;
+	SLiveStatsRegion *m_live_stats_region;
+};
+
+class CLiveStatsReader
+{
+public:
+	CLiveStatsReader();
+	~CLiveStatsReader();
+
+	bool init(const wchar_t *mapping_name = LIVE_STATS_MAPPING_NAME);
+	void close();
+
+	bool read(SLiveStatsSnapshot &live_stats_snapshot) const;
+
+private:
+	CSharedMemory m_shared_memory;
+	const SLiveStatsRegion *m_live_stats_region;
+};
\ No newline at end of file
@@ -0,0 +1,452 @@
+//
+//
+
+#include "stdafx.h"
+
+#include "file_system.h"
+#include "log_index.h"
+#include "log_compactor.h"
+
+namespace
+{
+	bool read_file(const std::wstring &file_name, std::wstring &file_data)
+	{
+		std::wifstream input_file(CFileSystem::get_stream_name(file_name).data());
+		if (!input_file.is_open())
+		{
+			return false;
+		}
+
+		file_data.assign(std::istreambuf_iterator<wchar_t>(input_file), std::istreambuf_iterator<wchar_t>());
+
+		return true;
+	}
+
+	uint64_t get_file_size(const std::wstring &file_name)
+	{
+		uint64_t file_size = 0;
+		CFileSystem::get_file_size(file_name, file_size);
+
+		return file_size;
+	}
+
+	// Only searches the given range, a search running to the end of the log for every record would make parsing quadratic
+	size_t find_key(const std::wstring &log_data, const wchar_t *key, size_t from_position, size_t to_position)
+	{
+		auto range_end = log_data.begin() + std::min(to_position, log_data.size());
+		auto key_iterator = std::search(log_data.begin() + std::min(from_position, log_data.size()), range_end, key, key + wcslen(key));
+
+		return key_iterator == range_end ? std::wstring::npos : static_cast<size_t>(key_iterator - log_data.begin());
+	}
+
+	bool find_number(const std::wstring &log_data, const wchar_t *key, size_t from_position, size_t to_position, uint64_t &number)
+	{
+		size_t key_position = find_key(log_data, key, from_position, to_position);
+		if (key_position == std::wstring::npos)
+		{
+			return false;
+		}
+
+		number = std::wcstoull(log_data.data() + key_position + wcslen(key), nullptr, 10);
+
+		return true;
+	}
+}
+
+CLogCompactor::CLogCompactor()
+{
+	m_log_index = nullptr;
+
+	m_retention_days = LOG_RETENTION_DAYS;
+	m_compaction_interval = LOG_COMPACTION_INTERVAL;
+
+	m_is_closing = false;
+
+	m_compaction_statistics = {};
+}
+
+CLogCompactor::~CLogCompactor()
+{
+	close();
+}
+
+bool CLogCompactor::init(const wchar_t *file_prefix, CLogIndex *log_index, uint32_t retention_days, DWORD compaction_interval)
+{
+	m_file_prefix = file_prefix;
+	m_log_index = log_index;
+
+	m_retention_days = retention_days;
+	m_compaction_interval = compaction_interval;
+
+	m_is_closing = false;
+	m_compaction_thread = std::thread(&CLogCompactor::compaction_thread, this);
+
+	return true;
+}
+
+void CLogCompactor::close()
+{
+	{
+		std::lock_guard<std::mutex> compaction_mutex(m_compaction_mutex);
+		m_is_closing = true;
+	}
+	m_compaction_condition.notify_all();
+
+	if (m_compaction_thread.joinable())
+	{
+		m_compaction_thread.join();
+	}
+}
+
+void CLogCompactor::compaction_thread()
+{
+	// Compaction must never compete with the input thread, lower both the CPU and the I/O priority of this thread
+#ifdef _WIN32
+	::SetThreadPriority(::GetCurrentThread(), THREAD_MODE_BACKGROUND_BEGIN);
+#endif // _WIN32
+
+	std::unique_lock<std::mutex> compaction_mutex(m_compaction_mutex);
+	while (!m_is_closing)
+	{
+		compaction_mutex.unlock();
+
+		compact_segments();
+		apply_retention();
+
+		compaction_mutex.lock();
+		m_compaction_condition.wait_for(compaction_mutex, std::chrono::milliseconds(m_compaction_interval), [this]() { return m_is_closing; });
+	}
+
+#ifdef _WIN32
+	::SetThreadPriority(::GetCurrentThread(), THREAD_MODE_BACKGROUND_END);
+#endif // _WIN32
+}
+
+void CLogCompactor::compact_segments()
+{
+	std::vector<SLogIndexEntry> closed_segments;
+	for (const auto &index_entry : m_log_index->get_entries())
+	{
+		if (index_entry.entry_type == ELogIndexEntryType::segment && index_entry.is_closed)
+		{
+			closed_segments.push_back(index_entry);
+		}
+	}
+
+	if (closed_segments.empty())
+	{
+		return;
+	}
+
+	// Segments have to be merged in the order they were written so that adjacent records can be collapsed
+	std::sort(closed_segments.begin(), closed_segments.end(),
+		[](const SLogIndexEntry &first_entry, const SLogIndexEntry &second_entry) { return first_entry.segment_number < second_entry.segment_number; });
+
+	for (const auto &closed_segment : closed_segments)
+	{
+		{
+			std::lock_guard<std::mutex> compaction_mutex(m_compaction_mutex);
+			if (m_is_closing)
+			{
+				break;
+			}
+		}
+
+		compact_segment(closed_segment.file_name, closed_segment.segment_number, closed_segment.last_record_time);
+	}
+
+#ifdef _DEBUG
+	SCompactionStatistics compaction_statistics = get_statistics();
+	uint64_t compaction_throughput = compaction_statistics.compaction_time ? compaction_statistics.bytes_read * 1000000 / compaction_statistics.compaction_time : 0;
+	::OutputDebugString(std::wstring(L"\n\t**Log compaction: " + std::to_wstring(compaction_statistics.compacted_segments) + L" segments, " +
+		std::to_wstring(compaction_statistics.records_read) + L" -> " + std::to_wstring(compaction_statistics.records_written) + L" records, " +
+		std::to_wstring(compaction_statistics.bytes_read) + L" -> " + std::to_wstring(compaction_statistics.bytes_written) + L" bytes, " +
+		std::to_wstring(compaction_throughput) + L" bytes/s").data());
+#endif
+}
+
+bool CLogCompactor::compact_segment(const std::wstring &segment_file_name, uint32_t segment_number, uint64_t segment_last_record_time)
+{
+	auto start_time = std::chrono::steady_clock::now();
+
+	std::wstring segment_data;
+	if (!read_file(segment_file_name, segment_data))
+	{
+		// The segment is gone, there's nothing left to compact
+		m_log_index->remove_entry(segment_file_name);
+		return false;
+	}
+
+	std::vector<SAppUsageRecord> segment_records;
+	parse_records(segment_data, segment_records);
+
+	// Split the records of this segment by the day they were written on; a segment open over midnight spans two days
+	std::map<std::wstring, std::vector<SAppUsageRecord>> day_records;
+	for (auto &segment_record : segment_records)
+	{
+		// Records written before they carried a timestamp are attributed to the end of their segment
+		if (!segment_record.record_time)
+		{
+			segment_record.record_time = segment_last_record_time;
+		}
+
+		day_records[get_day_file_name(m_file_prefix, segment_record.record_time)].push_back(segment_record);
+	}
+
+	uint64_t records_written = 0, bytes_written = 0;
+	for (const auto &day_record : day_records)
+	{
+		const std::wstring &day_file_name = day_record.first;
+
+		std::wstring day_data;
+		std::vector<SAppUsageRecord> app_usage_records;
+		uint32_t compacted_through_segment = 0;
+		if (read_file(day_file_name, day_data))
+		{
+			parse_records(day_data, app_usage_records, &compacted_through_segment);
+		}
+
+		// This segment was already merged into this day before a crash prevented it from being removed
+		if (compacted_through_segment >= segment_number)
+		{
+			continue;
+		}
+
+		uint64_t records_before = app_usage_records.size();
+		for (const auto &segment_record : day_record.second)
+		{
+			// Collapse adjacent records for the same app into one
+			if (!app_usage_records.empty() && app_usage_records.back().app_name == segment_record.app_name)
+			{
+				app_usage_records.back().duration += segment_record.duration;
+				app_usage_records.back().record_time = std::max(app_usage_records.back().record_time, segment_record.record_time);
+			}
+			else
+			{
+				app_usage_records.push_back(segment_record);
+			}
+		}
+
+		// The day file carries the last segment merged into it, so merging the same segment twice is detected above
+		std::wstring compacted_data = L"{\n\n\t \"compacted_through\" : " + std::to_wstring(segment_number) + L"\n}\n";
+		for (const auto &app_usage_record : app_usage_records)
+		{
+			compacted_data += L"{\n\n\t \"app_name\" : \"" + app_usage_record.app_name + L"\",\n\t \"duration\" : " + std::to_wstring(app_usage_record.duration) +
+				L",\n\t \"time\" : " + std::to_wstring(app_usage_record.record_time) + L"\n}\n";
+		}
+
+		std::wstring temp_file_name = day_file_name + L".tmp";
+		{
+			std::wofstream day_file(CFileSystem::get_stream_name(temp_file_name).data(), std::ios::trunc);
+			day_file << compacted_data;
+			day_file.flush();
+			if (!day_file)
+			{
+				return false;
+			}
+		}
+
+		uint64_t day_file_size = get_file_size(day_file_name);
+		if (!CFileSystem::replace_file(temp_file_name, day_file_name))
+		{
+			return false;
+		}
+
+		records_written += app_usage_records.size() - records_before;
+		bytes_written += get_file_size(day_file_name) - day_file_size;
+
+		SLogIndexEntry index_entry = {};
+		index_entry.entry_type = ELogIndexEntryType::day;
+		index_entry.file_name = day_file_name;
+		index_entry.first_record_time = app_usage_records.front().record_time;
+		index_entry.last_record_time = app_usage_records.back().record_time;
+		index_entry.is_closed = true;
+		for (const auto &app_usage_record : app_usage_records)
+		{
+			index_entry.first_record_time = std::min(index_entry.first_record_time, app_usage_record.record_time);
+			index_entry.last_record_time = std::max(index_entry.last_record_time, app_usage_record.record_time);
+		}
+		m_log_index->add_entry(index_entry);
+	}
+
+	uint64_t bytes_read = get_file_size(segment_file_name);
+
+	m_log_index->remove_entry(segment_file_name);
+	CFileSystem::delete_file(segment_file_name);
+
+	std::lock_guard<std::mutex> statistics_mutex(m_statistics_mutex);
+	m_compaction_statistics.compacted_segments++;
+	m_compaction_statistics.records_read += segment_records.size();
+	m_compaction_statistics.records_written += records_written;
+	m_compaction_statistics.bytes_read += bytes_read;
+	m_compaction_statistics.bytes_written += bytes_written;
+	m_compaction_statistics.compaction_time += std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start_time).count();
+
+	return true;
+}
+
+void CLogCompactor::apply_retention()
+{
+	uint64_t current_time = CHRONO_SYSTEM_TIME_SINCE_EPOCH_COUNT;
+	uint64_t retention_time = static_cast<uint64_t>(m_retention_days) * 24 * 60 * 60 * 1000;
+	if (current_time < retention_time)
+	{
+		return;
+	}
+
+	for (const auto &index_entry : m_log_index->get_entries())
+	{
+		if (index_entry.entry_type == ELogIndexEntryType::day && index_entry.last_record_time < current_time - retention_time)
+		{
+			m_log_index->remove_entry(index_entry.file_name);
+			CFileSystem::delete_file(index_entry.file_name);
+		}
+	}
+}
+
+SCompactionStatistics CLogCompactor::get_statistics() const
+{
+	std::lock_guard<std::mutex> statistics_mutex(m_statistics_mutex);
+
+	return m_compaction_statistics;
+}
+
+bool CLogCompactor::parse_records(const std::wstring &log_data, std::vector<SAppUsageRecord> &app_usage_records, uint32_t *compacted_through_segment)
+{
+	const wchar_t app_name_key[] = L"\"app_name\" : \"";
+	const wchar_t record_end_marker[] = L"\n}\n";
+
+	if (compacted_through_segment)
+	{
+		uint64_t segment_number = 0;
+		find_number(log_data, L"\"compacted_through\" : ", 0, log_data.find(record_end_marker), segment_number);
+		*compacted_through_segment = static_cast<uint32_t>(segment_number);
+	}
+
+	// Records written with a shared app identity table carry an app id instead of the app name. The name comes from the record mapping
+	// that id to it, which is written earlier in the same segment.
+	std::map<uint64_t, std::wstring> app_names;
+
+	size_t record_start = 0;
+	while (record_start < log_data.size())
+	{
+		size_t record_end = log_data.find(record_end_marker, record_start);
+		if (record_end == std::wstring::npos)
+		{
+			record_end = log_data.size();
+		}
+
+		// App paths can't contain a quote so the value of the app name ends at the next one
+		std::wstring app_name;
+		bool has_app_name = false; // Records written before the first app switch have an empty name
+		size_t app_name_position = find_key(log_data, app_name_key, record_start, record_end);
+		if (app_name_position != std::wstring::npos)
+		{
+			size_t app_name_start = app_name_position + wcslen(app_name_key);
+			size_t app_name_end = log_data.find(L'"', app_name_start);
+			if (app_name_end == std::wstring::npos || app_name_end > record_end)
+			{
+				return false;
+			}
+
+			app_name = log_data.substr(app_name_start, app_name_end - app_name_start);
+			has_app_name = true;
+		}
+
+		uint64_t app_id = 0;
+		bool has_app_id = find_number(log_data, L"\"app_id\" : ", record_start, record_end, app_id);
+
+		SAppUsageRecord app_usage_record = {};
+		if (find_number(log_data, L"\"duration\" : ", record_start, record_end, app_usage_record.duration))
+		{
+			if (!has_app_name && has_app_id)
+			{
+				// Keep the duration even if the record mapping the id was lost
+				auto app_name_iterator = app_names.find(app_id);
+				app_name = app_name_iterator != app_names.end() ? app_name_iterator->second : L"app_id:" + std::to_wstring(app_id);
+				has_app_name = true;
+			}
+
+			if (has_app_name)
+			{
+				app_usage_record.app_name = app_name;
+				find_number(log_data, L"\"time\" : ", record_start, record_end, app_usage_record.record_time);
+				app_usage_records.push_back(app_usage_record);
+			}
+		}
+		else if (has_app_id && has_app_name)
+		{
+			app_names[app_id] = app_name;
+		}
+
+		record_start = record_end + wcslen(record_end_marker);
+	}
+
+	return true;
+}
+
+uint32_t CLogCompactor::find_compacted_through_segment(const std::wstring &file_prefix)
+{
+	uint32_t compacted_through_segment = 0;
+
+	for (const auto &day_file_name : CFileSystem::find_files(file_prefix + L".*-*-*.json"))
+	{
+		std::wstring day_data;
+		if (!read_file(day_file_name, day_data))
+		{
+			continue;
+		}
+
+		uint64_t segment_number = 0;
+		if (find_number(day_data, L"\"compacted_through\" : ", 0, day_data.find(L"\n}\n"), segment_number))
+		{
+			compacted_through_segment = std::max(compacted_through_segment, static_cast<uint32_t>(segment_number));
+		}
+	}
+
+	return compacted_through_segment;
+}
+
+void CLogCompactor::sum_app_durations(const std::wstring &file_prefix, const CLogIndex &log_index, uint64_t from_time, std::map<std::wstring, uint64_t> &app_durations)
+{
+	std::wstring log_data;
+	std::vector<SAppUsageRecord> app_usage_records;
+
+	// Segments merged into the per-day file can still be on disk when a crash kept the compactor from deleting them
+	uint32_t compacted_through_segment = 0;
+	if (read_file(get_day_file_name(file_prefix, from_time), log_data))
+	{
+		parse_records(log_data, app_usage_records, &compacted_through_segment);
+	}
+
+	// Only the segments that can hold records of the day are read
+	for (const auto &index_entry : log_index.find_files(from_time, UINT64_MAX))
+	{
+		if (index_entry.entry_type == ELogIndexEntryType::segment && index_entry.segment_number > compacted_through_segment &&
+			read_file(index_entry.file_name, log_data))
+		{
+			parse_records(log_data, app_usage_records);
+		}
+	}
+
+	// A segment open over midnight also holds records of the day before
+	for (const auto &app_usage_record : app_usage_records)
+	{
+		if (app_usage_record.record_time >= from_time)
+		{
+			app_durations[app_usage_record.app_name] += app_usage_record.duration;
+		}
+	}
+}
+
+std::wstring CLogCompactor::get_day_file_name(const std::wstring &file_prefix, uint64_t record_time)
+{
+	time_t record_seconds = static_cast<time_t>(record_time / 1000);
+	tm record_date = { 0 };
+	localtime_s(&record_date, &record_seconds);
+
+	wchar_t day_suffix[32] = { 0 };
+	swprintf_s(day_suffix, L".%04d-%02d-%02d.json", record_date.tm_year + 1900, record_date.tm_mon + 1, record_date.tm_mday);
+
+	return file_prefix + day_suffix;
+}
\ No newline at end of file
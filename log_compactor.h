@@ -0,0 +1,71 @@
+//
+//
+
+#pragma once
+
+#define LOG_COMPACTION_INTERVAL		5 * 60 * 1000 // Look for closed segments this often, in milliseconds
+
+#define LOG_RETENTION_DAYS			30 // Per-day files older than this are deleted
+
+class CLogIndex;
+
+struct SAppUsageRecord
+{
+	std::wstring app_name;
+	uint64_t duration;
+	uint64_t record_time;
+};
+
+struct SCompactionStatistics
+{
+	uint64_t compacted_segments;
+	uint64_t records_read, records_written;
+	uint64_t bytes_read, bytes_written; // Size of the compacted segments and the growth of the per-day files
+	uint64_t compaction_time; // Time spent compacting, in microseconds
+};
+
+// Merges closed log segments into per-day files on a low priority background thread, collapsing adjacent records for the same app
+// into one, and deletes per-day files once they fall out of the retention window
+class CLogCompactor
+{
+public:
+	CLogCompactor();
+	~CLogCompactor();
+
+	bool init(const wchar_t *file_prefix, CLogIndex *log_index, uint32_t retention_days = LOG_RETENTION_DAYS, DWORD compaction_interval = LOG_COMPACTION_INTERVAL);
+	void close();
+
+	void compact_segments();
+	void apply_retention();
+
+	SCompactionStatistics get_statistics() const;
+
+	static bool parse_records(const std::wstring &log_data, std::vector<SAppUsageRecord> &app_usage_records, uint32_t *compacted_through_segment = nullptr);
+	static uint32_t find_compacted_through_segment(const std::wstring &file_prefix); // Highest segment merged into any per-day file on disk
+
+	// Adds up the durations of the records written since the given time of the current day, from the per-day file and the segments not yet
+	// merged into it
+	static void sum_app_durations(const std::wstring &file_prefix, const CLogIndex &log_index, uint64_t from_time, std::map<std::wstring, uint64_t> &app_durations);
+
+	static std::wstring get_day_file_name(const std::wstring &file_prefix, uint64_t record_time);
+
+private:
+	void compaction_thread();
+
+	bool compact_segment(const std::wstring &segment_file_name, uint32_t segment_number, uint64_t segment_last_record_time);
+
+	std::wstring m_file_prefix;
+
+	CLogIndex *m_log_index;
+
+	uint32_t m_retention_days;
+	DWORD m_compaction_interval;
+
+	std::thread m_compaction_thread;
+	std::mutex m_compaction_mutex;
+	std::condition_variable m_compaction_condition;
+	bool m_is_closing;
+
+	mutable std::mutex m_statistics_mutex;
+	SCompactionStatistics m_compaction_statistics;
+};
\ No newline at end of file
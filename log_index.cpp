@@ -0,0 +1,207 @@
+//
+//
+
+#include "stdafx.h"
+
+#include "file_system.h"
+#include "log_index.h"
+
+CLogIndex::CLogIndex()
+{
+
+}
+
+CLogIndex::~CLogIndex()
+{
+
+}
+
+bool CLogIndex::init(const wchar_t *file_name)
+{
+	if (!file_name || !*file_name)
+	{
+		return false;
+	}
+
+	m_file_name = file_name;
+	m_temp_file_name = m_file_name + L".tmp";
+
+	return true;
+}
+
+bool CLogIndex::load()
+{
+	std::lock_guard<std::mutex> index_mutex(m_index_mutex);
+
+	m_index_entries.clear();
+
+	std::wifstream index_file(CFileSystem::get_stream_name(m_file_name).data());
+	if (!index_file.is_open())
+	{
+		return false;
+	}
+
+	// Every line describes one file: <type> <segment number> <first record time> <last record time> <closed> <file name>
+	std::wstring index_line;
+	while (std::getline(index_file, index_line))
+	{
+		std::wistringstream line_stream(index_line);
+
+		std::wstring entry_type;
+		SLogIndexEntry index_entry = {};
+		if (!(line_stream >> entry_type >> index_entry.segment_number >> index_entry.first_record_time >> index_entry.last_record_time >> index_entry.is_closed))
+		{
+			continue;
+		}
+
+		line_stream >> std::ws;
+		std::getline(line_stream, index_entry.file_name);
+		if (index_entry.file_name.empty())
+		{
+			continue;
+		}
+
+		index_entry.entry_type = entry_type == L"day" ? ELogIndexEntryType::day : ELogIndexEntryType::segment;
+		m_index_entries.push_back(index_entry);
+	}
+
+	return true;
+}
+
+bool CLogIndex::save()
+{
+	std::lock_guard<std::mutex> index_mutex(m_index_mutex);
+
+	return save_entries();
+}
+
+void CLogIndex::add_entry(const SLogIndexEntry &index_entry)
+{
+	std::lock_guard<std::mutex> index_mutex(m_index_mutex);
+
+	// Replace the entry if this file is already listed
+	auto existing_entry = std::find_if(m_index_entries.begin(), m_index_entries.end(),
+		[&index_entry](const SLogIndexEntry &listed_entry) { return listed_entry.file_name == index_entry.file_name; });
+	if (existing_entry != m_index_entries.end())
+	{
+		*existing_entry = index_entry;
+	}
+	else
+	{
+		m_index_entries.push_back(index_entry);
+	}
+	save_entries();
+}
+
+void CLogIndex::remove_entry(const std::wstring &file_name)
+{
+	std::lock_guard<std::mutex> index_mutex(m_index_mutex);
+
+	m_index_entries.erase(std::remove_if(m_index_entries.begin(), m_index_entries.end(),
+		[&file_name](const SLogIndexEntry &index_entry) { return index_entry.file_name == file_name; }), m_index_entries.end());
+	save_entries();
+}
+
+void CLogIndex::update_time_range(const std::wstring &file_name, uint64_t record_time)
+{
+	std::lock_guard<std::mutex> index_mutex(m_index_mutex);
+
+	for (auto &index_entry : m_index_entries)
+	{
+		if (index_entry.file_name == file_name)
+		{
+			if (!index_entry.first_record_time || record_time < index_entry.first_record_time)
+			{
+				index_entry.first_record_time = record_time;
+			}
+			index_entry.last_record_time = std::max(index_entry.last_record_time, record_time);
+
+			// The range of the open segment is only persisted when it's closed or when another entry changes. A crash in between
+			// leaves its range narrower than the records it holds until the writer resumes the segment and rebuilds it.
+			break;
+		}
+	}
+}
+
+void CLogIndex::set_time_range(const std::wstring &file_name, uint64_t first_record_time, uint64_t last_record_time)
+{
+	std::lock_guard<std::mutex> index_mutex(m_index_mutex);
+
+	for (auto &index_entry : m_index_entries)
+	{
+		if (index_entry.file_name == file_name)
+		{
+			index_entry.first_record_time = first_record_time;
+			index_entry.last_record_time = last_record_time;
+			save_entries();
+			break;
+		}
+	}
+}
+
+void CLogIndex::close_segment(uint32_t segment_number)
+{
+	std::lock_guard<std::mutex> index_mutex(m_index_mutex);
+
+	for (auto &index_entry : m_index_entries)
+	{
+		if (index_entry.entry_type == ELogIndexEntryType::segment && index_entry.segment_number == segment_number)
+		{
+			index_entry.is_closed = true;
+		}
+	}
+	save_entries();
+}
+
+std::vector<SLogIndexEntry> CLogIndex::get_entries() const
+{
+	std::lock_guard<std::mutex> index_mutex(m_index_mutex);
+
+	return m_index_entries;
+}
+
+std::vector<SLogIndexEntry> CLogIndex::find_files(uint64_t from_time, uint64_t to_time) const
+{
+	std::lock_guard<std::mutex> index_mutex(m_index_mutex);
+
+	std::vector<SLogIndexEntry> index_entries;
+	for (const auto &index_entry : m_index_entries)
+	{
+		// A segment that is still open may receive records later than the range recorded so far, and a file whose range is unknown
+		// could hold records of any time
+		bool is_range_known = index_entry.first_record_time != 0;
+		uint64_t last_record_time = index_entry.is_closed && is_range_known ? index_entry.last_record_time : UINT64_MAX;
+		if (index_entry.first_record_time <= to_time && last_record_time >= from_time)
+		{
+			index_entries.push_back(index_entry);
+		}
+	}
+
+	return index_entries;
+}
+
+bool CLogIndex::save_entries()
+{
+	{
+		std::wofstream index_file(CFileSystem::get_stream_name(m_temp_file_name).data(), std::ios::trunc);
+		if (!index_file.is_open())
+		{
+			return false;
+		}
+
+		for (const auto &index_entry : m_index_entries)
+		{
+			index_file << (index_entry.entry_type == ELogIndexEntryType::day ? L"day " : L"segment ") << index_entry.segment_number << L' ' <<
+				index_entry.first_record_time << L' ' << index_entry.last_record_time << L' ' << index_entry.is_closed << L' ' << index_entry.file_name << L'\n';
+		}
+
+		index_file.flush();
+		if (!index_file)
+		{
+			return false;
+		}
+	}
+
+	// Replace the index atomically so that readers never see a partially written one
+	return CFileSystem::replace_file(m_temp_file_name, m_file_name);
+}
\ No newline at end of file
@@ -0,0 +1,56 @@
+//
+//
+
+#pragma once
+
+// Milliseconds since the UNIX epoch, the time the records and the index are kept in
+#define CHRONO_SYSTEM_TIME_SINCE_EPOCH_COUNT \
+							static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch()).count())
+
+enum class ELogIndexEntryType
+{
+	segment, // Numbered segment written by CFileWriter
+	day, // Per-day file produced by CLogCompactor
+};
+
+struct SLogIndexEntry
+{
+	ELogIndexEntryType entry_type;
+	uint32_t segment_number; // Only valid for segments
+	std::wstring file_name;
+	uint64_t first_record_time, last_record_time; // Milliseconds since the UNIX epoch, both zero while the range is unknown
+	bool is_closed; // A closed segment is no longer written to and can be compacted
+};
+
+// Lists the log segments and per-day files together with the time range of the records they hold, so that readers only need to
+// open the files that overlap the time range they are interested in. The index is shared by the writer and the compactor.
+class CLogIndex
+{
+public:
+	CLogIndex();
+	~CLogIndex();
+
+	bool init(const wchar_t *file_name);
+
+	bool load();
+	bool save();
+
+	void add_entry(const SLogIndexEntry &index_entry);
+	void remove_entry(const std::wstring &file_name);
+	void update_time_range(const std::wstring &file_name, uint64_t record_time);
+	void set_time_range(const std::wstring &file_name, uint64_t first_record_time, uint64_t last_record_time); // Rebuilt from the records on disk
+	void close_segment(uint32_t segment_number);
+
+	std::vector<SLogIndexEntry> get_entries() const;
+	std::vector<SLogIndexEntry> find_files(uint64_t from_time, uint64_t to_time) const;
+
+private:
+	bool save_entries();
+
+	mutable std::mutex m_index_mutex;
+
+	std::wstring m_file_name;
+	std::wstring m_temp_file_name;
+
+	std::vector<SLogIndexEntry> m_index_entries;
+};
\ No newline at end of file
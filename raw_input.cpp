@@ -2,7 +2,17 @@
 //
 
 #include "stdafx.h"
+#include "log_index.h"
 #include "file_writer.h"
+#include "log_compactor.h"
+#include "checkpoint.h"
+#include "shared_memory.h"
+#include "live_stats.h"
+#include "app_identity_table.h"
+#include "adaptive_sampling.h"
+#include "input_accounting.h"
+#include "trace_recorder.h"
+#include "input_trace.h"
 #include "raw_input.h"
 
 #define CHRONO_TIME_SINCE_EPOCH_COUNT \
@@ -10,33 +20,69 @@
 
 CRawInput::CRawInput()
 {
-	m_key_down_counter = 0;
+	m_clock = []() { return static_cast<uint64_t>(CHRONO_TIME_SINCE_EPOCH_COUNT); };
+	m_input_accounting.reset(m_clock());
 
-	m_last_accumulated_time = 0;
+	m_written_record_count = 0;
+	m_today_day_of_year = -1;
+	m_checkpoint_failure_count = 0;
+	m_published_key_event_count = m_published_mouse_event_count = m_published_time = 0;
 
-	m_input_hardware_start_time = m_input_hardware_accumulated_time = m_last_accumulated_time = 0;
+	m_is_raw_mouse_registered = false;
 
-	m_input_monitor_timer_queue = m_input_monitor_timer_queue_timer = nullptr;
+	m_input_trace_time = 0;
+
+	m_input_monitor_timer_queue = m_input_monitor_timer_queue_timer = m_input_monitor_checkpoint_timer = m_live_stats_timer = m_input_probe_timer = nullptr;
+	m_window_handle = nullptr;
+
+	m_recently_used_app_id = m_segment_app_ids_segment = 0;
 }
 
 CRawInput::~CRawInput()
 {
 	destroy_input_monitor_timer_queue();
+
+	m_log_compactor.close();
+
+	// Persist whatever has been accumulated since the last periodic checkpoint
+	save_checkpoint();
 }
 
-bool CRawInput::init(HWND window_handle)
+bool CRawInput::init(HWND window_handle, bool is_adaptive_sampling_enabled, bool is_app_identity_table_enabled, bool is_input_recorded)
 {
+	m_window_handle = window_handle;
+	{
+		std::lock_guard<std::mutex> hardware_usage_mutex(m_input_hardware_mutex);
+		m_input_accounting.enable_adaptive_sampling(is_adaptive_sampling_enabled);
+
+		// The recorded input is what the sampling policy is replayed against
+		if (is_input_recorded)
+		{
+			m_input_trace_file.open(INPUT_TRACE_FILE_NAME, std::ios::trunc);
+			m_input_trace_time = m_clock();
+		}
+	}
+
+	// With many monitors on a host, one per session, the app paths are interned once in a table shared by all of them and the records
+	// only carry the ids. Without the table the paths are written as they are.
+	if (is_app_identity_table_enabled && !m_app_identity_table.init())
+	{
+		::MessageBoxW(window_handle, L"The app identity table shared by the sessions isn't available. Start the host with /host_shared_app_ids as a "
+			L"service or as SYSTEM before the monitors.", L"App input monitor", MB_OK | MB_ICONERROR);
+		return false;
+	}
+
 	// We will only be monitoring inputs from keyboard and mouse so let's register those devices
 	constexpr int number_of_devices = 2;
 	RAWINPUTDEVICE raw_input_devices[number_of_devices] = { 0 };
 
-	// Keyboard
+	// Mouse
 	raw_input_devices[0].usUsagePage = 0x1;
 	raw_input_devices[0].usUsage = 0x2;
 	raw_input_devices[0].dwFlags = RIDEV_INPUTSINK;
 	raw_input_devices[0].hwndTarget = window_handle;
 
-	// Mouse
+	// Keyboard
 	raw_input_devices[1].usUsagePage = 0x1;
 	raw_input_devices[1].usUsage = 0x6;
 	raw_input_devices[1].dwFlags = RIDEV_INPUTSINK;
@@ -47,19 +93,34 @@ bool CRawInput::init(HWND window_handle)
 	{
 		return false;
 	}
+	m_is_raw_mouse_registered = true;
+
+	// The log is written as numbered segments which are merged into per-day files in the background
+	m_log_index.init(L"app_input_data.index");
+	m_log_index.load();
+	m_file_writer.init(L"app_input_data", &m_log_index, CLogCompactor::find_compacted_through_segment(L"app_input_data"));
+
+	// The live stats show the totals of the whole day, not only what was written since the monitor started
+	restore_today_app_durations();
+
+	m_checkpoint.init(L"app_input_data.checkpoint");
+	restore_checkpoint();
+
+	// Dashboards poll the live stats from shared memory instead of tailing the log
+	m_live_stats_publisher.init();
 
 	create_input_monitor_timer_queue();
 
-	m_file_writer.init(L"app_input_data.json");
+	m_log_compactor.init(L"app_input_data", &m_log_index);
 
 	return true;
 }
 
 bool CRawInput::read_input_data(LPARAM lparam)
 {
-	UINT input_size = 0;
+	TRACE_SCOPE("CRawInput::read_input_data");
 
-	std::wstring message;
+	UINT input_size = 0;
 
 	// Get the size of raw input data
 	::GetRawInputData(reinterpret_cast<HRAWINPUT>(lparam), RID_INPUT, nullptr, &input_size, sizeof(RAWINPUTHEADER));
@@ -78,60 +139,11 @@ bool CRawInput::read_input_data(LPARAM lparam)
 		case RIM_TYPEKEYBOARD: // So we have keyboard data
 			if (raw_input->data.keyboard.Flags == RI_KEY_MAKE) // Key is down
 			{
-				std::lock_guard<std::mutex> hardware_usage_mutex(m_input_hardware_mutex);
-
-				// A user could have continuously pressed one or more keys so let's filter it out here
-				if (std::find(m_keydown_virtual_keys.begin(), m_keydown_virtual_keys.end(), raw_input->data.keyboard.VKey) == m_keydown_virtual_keys.end())
-				{
-					// If no key is down, let's assign the current time
-					if (is_keyboard_activity_inactive() && is_mouse_activity_inactive())
-					{
-						m_input_hardware_start_time = CHRONO_TIME_SINCE_EPOCH_COUNT;
-					}
-
-					// This key was not down before
-					m_keydown_virtual_keys.push_back(raw_input->data.keyboard.VKey);
-					m_key_down_counter++;
-
-#ifdef _DEBUG
-					message.append(L"\n\tKey is down; **counter: " + std::to_wstring(m_key_down_counter));
-					::OutputDebugString(message.data());
-#endif // _DEBUG
-				}
+				on_key_down(raw_input->data.keyboard.VKey);
 			}
 			else if (raw_input->data.keyboard.Flags == RI_KEY_BREAK) // Key is up
 			{
-				std::lock_guard<std::mutex> hardware_usage_mutex(m_input_hardware_mutex);
-
-				// If a key was previously down, let's check and remove it from the container
-				if (std::find(m_keydown_virtual_keys.begin(), m_keydown_virtual_keys.end(), raw_input->data.keyboard.VKey) != m_keydown_virtual_keys.end())
-				{
-					// This key was down before so let's remove it from the container
-					m_keydown_virtual_keys.remove(raw_input->data.keyboard.VKey);
-					m_key_down_counter--;
-
-#ifdef _DEBUG
-					message.append(L"\n\tKey is up; **counter: " + std::to_wstring(m_key_down_counter));
-					::OutputDebugString(message.data());
-#endif // _DEBUG
-
-					// Check if all the keys from the keyboard have been released
-					if (is_keyboard_activity_inactive() && is_mouse_activity_inactive())
-					{
-						// This means all the pressed keys have been released
-						m_input_hardware_accumulated_time += CHRONO_TIME_SINCE_EPOCH_COUNT - 
-							(m_input_hardware_start_time == 0 ? CHRONO_TIME_SINCE_EPOCH_COUNT : m_input_hardware_start_time);
-						m_last_accumulated_time = m_input_hardware_accumulated_time;
-						m_accumulated_input_duration.push_back(m_last_accumulated_time);
-
-						m_input_hardware_start_time = 0; // Reset keyboard start time
-
-#ifdef _DEBUG
-						message.append(L"\n\t\t**None of the keys are down: **" + std::to_wstring(m_input_hardware_accumulated_time));
-						::OutputDebugString(message.data());
-#endif
-					}
-				}
+				on_key_up(raw_input->data.keyboard.VKey);
 			}
 			break;
 
@@ -164,13 +176,13 @@ bool CRawInput::read_input_data(LPARAM lparam)
 				break;
 
 			case RI_MOUSE_WHEEL:
-				on_mouse_wheel_scroll(static_cast<uint16_t>(RI_MOUSE_WHEEL));
+				on_mouse_wheel_scroll();
 				break;
 			}
 
 			if (raw_input->data.mouse.lLastX || raw_input->data.mouse.lLastY)
 			{
-				on_mouse_movement(MOUSE_CURSOR_MOVEMENT_MESSAGE);
+				on_mouse_movement();
 			}
 			break;
 		}
@@ -179,26 +191,40 @@ bool CRawInput::read_input_data(LPARAM lparam)
 	return true;
 }
 
+void CRawInput::on_key_down(uint16_t virtual_key)
+{
+	TRACE_SCOPE("CRawInput::on_key_down");
+
+	TRACE_LOCK_GUARD(hardware_usage_mutex, m_input_hardware_mutex);
+
+	uint64_t current_time = m_clock();
+	record_input_trace(EInputTraceEvent::key_down, virtual_key, current_time);
+
+	on_sampling_mode_changed(m_input_accounting.on_key_down(virtual_key, current_time));
+}
+
+void CRawInput::on_key_up(uint16_t virtual_key)
+{
+	TRACE_SCOPE("CRawInput::on_key_up");
+
+	TRACE_LOCK_GUARD(hardware_usage_mutex, m_input_hardware_mutex);
+
+	uint64_t current_time = m_clock();
+	record_input_trace(EInputTraceEvent::key_up, virtual_key, current_time);
+
+	m_input_accounting.on_key_up(virtual_key, current_time);
+}
+
 void CRawInput::on_mouse_activated(uint16_t button_flag)
 {
-	std::lock_guard<std::mutex> hardware_usage_mutex(m_input_hardware_mutex);
+	TRACE_SCOPE("CRawInput::on_mouse_activated");
 
-	// Check to prevent insertion of button flag more than once from mouse and touchpad
-	if (std::find(m_mouse_activity.begin(), m_mouse_activity.end(), button_flag) == m_mouse_activity.end()) // This button hasn't been pressed
-	{
-		// Let's check if this is an initial mouse activity. If it is then we start tracking it's duration
-		if (m_mouse_activity.empty())
-		{
-			m_input_hardware_start_time = CHRONO_TIME_SINCE_EPOCH_COUNT;
-		}
+	TRACE_LOCK_GUARD(hardware_usage_mutex, m_input_hardware_mutex);
 
-		m_mouse_activity.push_back(button_flag);
-	}
-	else // This button was already being pressed before so it could have been pressed again from either touchpad or mouse
-	{
-		// Insert this duplicate mouse button down data in a different container
-		m_duplicate_mouse_activity.push_back(button_flag);
-	}
+	uint64_t current_time = m_clock();
+	record_input_trace(EInputTraceEvent::button_down, button_flag, current_time);
+
+	on_sampling_mode_changed(m_input_accounting.on_mouse_activated(button_flag, current_time));
 
 #ifdef _DEBUG
 	switch (button_flag)
@@ -220,41 +246,14 @@ void CRawInput::on_mouse_activated(uint16_t button_flag)
 
 void CRawInput::on_mouse_deactivated(uint16_t button_flag)
 {
-	std::lock_guard<std::mutex> hardware_usage_mutex(m_input_hardware_mutex);
-
-	std::wstring mouse_activated_time;
-
-	// Check if this button flag is already present in the container
-	if (std::find(m_mouse_activity.begin(), m_mouse_activity.end(), button_flag) != m_mouse_activity.end()) // This button flag is present
-	{
-		// One or more buttons could have been pressed from both mouse and touchpad
+	TRACE_SCOPE("CRawInput::on_mouse_deactivated");
 
-		// There could have been same mouse buttons down: button click from mouse and another button click from touchpad. So a user could have released one
-		// button while the other button is still down.
-		if (std::find(m_duplicate_mouse_activity.begin(), m_duplicate_mouse_activity.end(), button_flag) != m_duplicate_mouse_activity.end()) // Duplicate data exists
-		{
-			m_duplicate_mouse_activity.remove(button_flag);
-		}
-		else // No duplicate button down exists for this mouse button
-		{
-			// Remove this button flag from the container as it has been released by the user
-			m_mouse_activity.remove(button_flag);
-		}
+	TRACE_LOCK_GUARD(hardware_usage_mutex, m_input_hardware_mutex);
 
-		// If the mouse activity container is empty then that means we should accumulate it's usage time
-		if (is_mouse_activity_inactive() && is_keyboard_activity_inactive())
-		{
-			m_input_hardware_accumulated_time = CHRONO_TIME_SINCE_EPOCH_COUNT - 
-				(m_input_hardware_start_time == 0 ? CHRONO_TIME_SINCE_EPOCH_COUNT : m_input_hardware_start_time);;
-			m_last_accumulated_time = m_input_hardware_accumulated_time;
-			m_accumulated_input_duration.push_back(m_last_accumulated_time);
+	uint64_t current_time = m_clock();
+	record_input_trace(EInputTraceEvent::button_up, button_flag, current_time);
 
-#ifdef _DEBUG
-			mouse_activated_time.append(L"\n\t\t**Mouse activated time: " + std::to_wstring(m_input_hardware_accumulated_time));
-			::OutputDebugString(mouse_activated_time.data());
-#endif // _DEBUG
-		}
-	}
+	m_input_accounting.on_mouse_deactivated(button_flag, current_time);
 
 #ifdef _DEBUG
 	switch (button_flag)
@@ -274,189 +273,294 @@ void CRawInput::on_mouse_deactivated(uint16_t button_flag)
 #endif // _DEBUG
 }
 
-void CRawInput::on_mouse_wheel_scroll(uint16_t mouse_wheel_flag)
+void CRawInput::on_mouse_wheel_scroll()
 {
-	std::lock_guard<std::mutex> hardware_usage_mutex(m_input_hardware_mutex);
+	TRACE_SCOPE("CRawInput::on_mouse_wheel_scroll");
 
-	// Let's check if mouse wheel scroll activity is already being tracked
-	if (is_mouse_activity_active()) // Mouse wheel scroll activity is already being tracked
-	{
-		// Check if this mouse wheel wheel flag is already present in the container
-		if (std::find(m_mouse_activity.begin(), m_mouse_activity.end(), mouse_wheel_flag) != m_mouse_activity.end()) // This mouse wheel flag is present
-		{
-			// This could mean that it's second mouse wheel message so we calculate the time elapsed from the first mouse wheel message
-			// but only if keyboard activity is not present
-			if (is_keyboard_activity_inactive()) // There's no keyboard activity
-			{
-				m_input_hardware_accumulated_time = CHRONO_TIME_SINCE_EPOCH_COUNT - m_input_hardware_start_time;
-				m_last_accumulated_time = m_input_hardware_accumulated_time;
-				m_accumulated_input_duration.push_back(m_last_accumulated_time);
+	TRACE_LOCK_GUARD(hardware_usage_mutex, m_input_hardware_mutex);
 
-#ifdef _DEBUG
-				::OutputDebugString(std::wstring(L"\n\t\t**Mouse wheel scroll ended: Accumulated time: " + std::to_wstring(m_input_hardware_accumulated_time)).data());
-#endif // _DEBUG
-			}
+	uint64_t current_time = m_clock();
+	record_input_trace(EInputTraceEvent::mouse_wheel, 0, current_time);
 
-			m_mouse_activity.remove(mouse_wheel_flag);
-		}
-		else // This mouse activity data is not present in our container
-		{
-			// So, let's add it
-			m_mouse_activity.push_back(mouse_wheel_flag);
-		}
-	}
+	on_sampling_mode_changed(m_input_accounting.on_mouse_wheel_scroll(current_time));
+}
 
-	// Check if this mouse wheel flag is already present in the container
-	else if (std::find(m_mouse_activity.begin(), m_mouse_activity.end(), mouse_wheel_flag) == m_mouse_activity.end()) // This mouse wheel flag isn't present
-	{
-		// We only assign initial time when both keyboard and mouse data are inactive
-		if (is_keyboard_activity_inactive() && is_mouse_activity_inactive())
-		{
-			// Assign an initial time
-			m_input_hardware_start_time = CHRONO_TIME_SINCE_EPOCH_COUNT;
-		}
-		
-		// Either keyboard or mouse activity is already being tracked
-		m_mouse_activity.push_back(mouse_wheel_flag);
+void CRawInput::on_mouse_movement()
+{
+	TRACE_SCOPE("CRawInput::on_mouse_movement");
+
+	TRACE_LOCK_GUARD(hardware_usage_mutex, m_input_hardware_mutex);
+
+	uint64_t current_time = m_clock();
+	record_input_trace(EInputTraceEvent::mouse_movement, 0, current_time);
+
+	on_sampling_mode_changed(m_input_accounting.on_mouse_movement(current_time));
+}
 
+void CRawInput::on_app_switched(std::wstring &switched_app_path)
+{
+	TRACE_SCOPE("CRawInput::on_app_switched");
+
+	TRACE_LOCK_GUARD(hardware_usage_mutex, m_input_hardware_mutex);
+
+	// Everything up to the switch, including the time the keys or buttons that are still held have been held for so far, was spent in
+	// the app that was in use, so its record is written before the app changes
+	uint64_t total_duration = m_input_accounting.collect_input_duration(m_clock());
 #ifdef _DEBUG
-		::OutputDebugString(L"\n\tMouse wheel scroll");
+	::OutputDebugString(std::wstring(L"\n\n\t\t\t**App switched. Total duration: " + std::to_wstring(total_duration)).data());
 #endif // _DEBUG
-	}
+
+	write_app_usage_record(total_duration);
+
+	m_recently_used_app_path = switched_app_path;
+	m_recently_used_app_id = m_app_identity_table.intern(m_recently_used_app_path);
 }
 
-void CRawInput::on_mouse_movement(uint16_t mouse_movement_flag) 
+bool CRawInput::is_keyboard_activity_active()
 {
 	std::lock_guard<std::mutex> hardware_usage_mutex(m_input_hardware_mutex);
 
-	// Let's check if mouse activity is already being tracked
-	if (is_mouse_activity_active()) // Mouse activity is already being tracked
-	{
-		// Check if this mouse movement flag is already present in the container
-		if (std::find(m_mouse_activity.begin(), m_mouse_activity.end(), mouse_movement_flag) != m_mouse_activity.end()) // This mouse movement flag is present
-		{
-			// This could mean that it's second mouse movement message so we calculate the elapsed time from the first mouse movement 
-			// but only if keyboard activity is not present
-			if (is_keyboard_activity_inactive()) // There's no keyboard activity
-			{
-				m_input_hardware_accumulated_time = CHRONO_TIME_SINCE_EPOCH_COUNT - m_input_hardware_start_time;
-				m_last_accumulated_time = m_input_hardware_accumulated_time;
-				m_accumulated_input_duration.push_back(m_last_accumulated_time);
+	return m_input_accounting.is_keyboard_activity_active();
+}
+
+bool CRawInput::is_keyboard_activity_inactive()
+{
+	std::lock_guard<std::mutex> hardware_usage_mutex(m_input_hardware_mutex);
+
+	return m_input_accounting.is_keyboard_activity_inactive();
+}
+
+bool CRawInput::is_mouse_activity_active()
+{
+	std::lock_guard<std::mutex> hardware_usage_mutex(m_input_hardware_mutex);
+
+	return m_input_accounting.is_mouse_activity_active();
+}
+
+bool CRawInput::is_mouse_activity_inactive()
+{
+	std::lock_guard<std::mutex> hardware_usage_mutex(m_input_hardware_mutex);
+
+	return m_input_accounting.is_mouse_activity_inactive();
+}
+
+void CRawInput::reset_hardware_usage_time()
+{
+	TRACE_SCOPE("CRawInput::reset_hardware_usage_time");
+
+	TRACE_LOCK_GUARD(hardware_usage_mutex, m_input_hardware_mutex);
 
+	uint64_t total_duration = m_input_accounting.collect_input_duration(m_clock());
 #ifdef _DEBUG
-				::OutputDebugString(std::wstring(L"\n\t\t**Mouse movement ended: Accumulated time: " + std::to_wstring(m_input_hardware_accumulated_time)).data());
+	::OutputDebugString(std::wstring(L"\n\n\t\t\t**Timer fired. Total duration: " + std::to_wstring(total_duration)).data());
 #endif // _DEBUG
-			}
 
-			m_mouse_activity.remove(mouse_movement_flag);
-		}
-		else // This mouse activity data is not present in our container
-		{
-			// So, let's add it
-			m_mouse_activity.push_back(mouse_movement_flag);
-		}
+	write_app_usage_record(total_duration);
+}
+
+void CRawInput::probe_input_activity()
+{
+	TRACE_SCOPE("CRawInput::probe_input_activity");
+
+	LASTINPUTINFO last_input_info = { sizeof(LASTINPUTINFO) };
+	if (!::GetLastInputInfo(&last_input_info))
+	{
+		return;
 	}
+	DWORD idle_time = ::GetTickCount() - last_input_info.dwTime;
 
-	// Check if this mouse movement flag is already present in the container
-	else if (std::find(m_mouse_activity.begin(), m_mouse_activity.end(), mouse_movement_flag) == m_mouse_activity.end()) // This mouse movement isn't present
+	// The raw button flags are for the physical buttons while the virtual keys follow the swapped buttons of a left-handed setup
+	bool is_swapped = ::GetSystemMetrics(SM_SWAPBUTTON) != 0;
+	uint16_t held_button_flags = 0;
+	if (::GetAsyncKeyState(VK_LBUTTON) & 0x8000)
 	{
-		// We only assign initial time when both keyboard and mouse data are inactive
-		if (is_keyboard_activity_inactive() && is_mouse_activity_inactive())
-		{
-			// Assign an initial time
-			m_input_hardware_start_time = CHRONO_TIME_SINCE_EPOCH_COUNT;
-		}
+		held_button_flags |= is_swapped ? RI_MOUSE_RIGHT_BUTTON_DOWN : RI_MOUSE_LEFT_BUTTON_DOWN;
+	}
+	if (::GetAsyncKeyState(VK_RBUTTON) & 0x8000)
+	{
+		held_button_flags |= is_swapped ? RI_MOUSE_LEFT_BUTTON_DOWN : RI_MOUSE_RIGHT_BUTTON_DOWN;
+	}
+	if (::GetAsyncKeyState(VK_MBUTTON) & 0x8000)
+	{
+		held_button_flags |= RI_MOUSE_MIDDLE_BUTTON_DOWN;
+	}
 
-		// Either keyboard or mouse activity is already being tracked
-		m_mouse_activity.push_back(mouse_movement_flag);
+	TRACE_LOCK_GUARD(hardware_usage_mutex, m_input_hardware_mutex);
 
+	uint64_t current_time = m_clock();
+	if (m_input_accounting.on_input_probe(current_time, current_time - idle_time, held_button_flags))
+	{
 #ifdef _DEBUG
-		::OutputDebugString(L"\n\tMouse movement");
+		::OutputDebugString(L"\n\t**Input probe: user is idle or holds a button, resuming full rate mouse input");
 #endif // _DEBUG
+
+		on_sampling_mode_changed(true);
 	}
 }
 
-void CRawInput::on_app_switched(std::wstring &switched_app_path)
+void CRawInput::apply_sampling_mode()
 {
-	std::lock_guard<std::mutex> hardware_usage_mutex(m_input_hardware_mutex);
-
-	m_recently_used_app_path = switched_app_path;
+	bool is_probing = false;
+	{
+		TRACE_LOCK_GUARD(hardware_usage_mutex, m_input_hardware_mutex);
+		is_probing = m_input_accounting.is_probing();
+	}
 
-	m_input_hardware_accumulated_time = m_last_accumulated_time = 0;
+	// Raw input has to be registered from the thread that owns the input window, which is why mode changes are posted to it
+	if (is_probing && m_is_raw_mouse_registered)
+	{
+		m_is_raw_mouse_registered = !register_raw_mouse(false);
 
-	// A user could have just scrolled once or moved his mouse once so we check and remove this data cause this data will hamper the 
-	// calculation of total accumulation duration in the next sequence
-	if (!m_mouse_activity.empty()) // There are one or more mouse activity messages
+		if (!m_input_probe_timer && m_input_monitor_timer_queue)
+		{
+			::CreateTimerQueueTimer(
+				&m_input_probe_timer,
+				m_input_monitor_timer_queue,
+				input_probe_timer_routine,
+				nullptr,
+				ADAPTIVE_SAMPLING_PROBE_INTERVAL,
+				ADAPTIVE_SAMPLING_PROBE_INTERVAL,
+				0);
+		}
+	}
+	else if (!is_probing && !m_is_raw_mouse_registered)
 	{
-		m_mouse_activity.remove(RI_MOUSE_WHEEL);
-		m_mouse_activity.remove(MOUSE_CURSOR_MOVEMENT_MESSAGE);
+		m_is_raw_mouse_registered = register_raw_mouse(true);
+
+		// The probe only runs while throttled so that it adds no wakeups at full rate
+		if (m_input_probe_timer)
+		{
+			::DeleteTimerQueueTimer(m_input_monitor_timer_queue, m_input_probe_timer, nullptr);
+			m_input_probe_timer = nullptr;
+		}
 	}
+}
 
-	// Let's accumulate the total duration elapsed from all the inputs
-	uint64_t total_duration = 0;
-	for (const auto &time_elapsed : m_accumulated_input_duration)
+bool CRawInput::register_raw_mouse(bool is_registered)
+{
+	// Only the mouse, the keyboard stays registered
+	RAWINPUTDEVICE raw_input_device = { 0 };
+	raw_input_device.usUsagePage = 0x1;
+	raw_input_device.usUsage = 0x2;
+	raw_input_device.dwFlags = is_registered ? RIDEV_INPUTSINK : RIDEV_REMOVE;
+	raw_input_device.hwndTarget = is_registered ? m_window_handle : nullptr;
+
+	return ::RegisterRawInputDevices(&raw_input_device, 1, sizeof(raw_input_device)) != FALSE;
+}
+
+void CRawInput::record_input_trace(EInputTraceEvent trace_event, uint16_t input_code, uint64_t current_time)
+{
+	if (!m_input_trace_file.is_open())
 	{
-		total_duration += time_elapsed;
+		return;
 	}
-	m_accumulated_input_duration.clear(); // Clear this container
-#ifdef _DEBUG
-	::OutputDebugString(std::wstring(L"\n\n\t\t\t**App switched. Total duration: " + std::to_wstring(total_duration)).data());
-#endif // _DEBUG
 
-	// Assign an initial time
-	m_input_hardware_start_time = CHRONO_TIME_SINCE_EPOCH_COUNT;
+	SInputTraceEvent input_trace_event = {};
+	input_trace_event.event_time = current_time;
+	input_trace_event.trace_event = trace_event;
+	input_trace_event.input_code = input_code;
+	CInputTrace::write(m_input_trace_file, input_trace_event, m_input_trace_time);
 
-	std::wstring json_buffer = L"{\n\n\t \"app_name\" : \"" + m_recently_used_app_path + L"\",\n\t \"duration\" : " + std::to_wstring(total_duration) + L"\n}\n";
-	m_file_writer.write_data(json_buffer.data());
+	m_input_trace_time = current_time;
 }
 
-bool CRawInput::is_keyboard_activity_active() const
+bool CRawInput::check_accounting_invariants()
 {
-	return m_key_down_counter != 0;
+	std::lock_guard<std::mutex> hardware_usage_mutex(m_input_hardware_mutex);
+
+	return m_input_accounting.check_invariants(m_clock());
 }
 
-bool CRawInput::is_keyboard_activity_inactive() const
+uint64_t CRawInput::get_total_accumulated_time()
 {
-	return m_key_down_counter == 0;
+	std::lock_guard<std::mutex> hardware_usage_mutex(m_input_hardware_mutex);
+
+	return m_input_accounting.get_total_accumulated_time();
 }
 
-bool CRawInput::is_mouse_activity_active() const
+uint64_t CRawInput::get_missed_input_event_count()
 {
-	return !m_mouse_activity.empty();
+	std::lock_guard<std::mutex> hardware_usage_mutex(m_input_hardware_mutex);
+
+	return m_input_accounting.get_missed_input_event_count();
 }
 
-bool CRawInput::is_mouse_activity_inactive() const
+void CRawInput::set_clock(const std::function<uint64_t()> &clock)
 {
-	return m_mouse_activity.empty();
+	std::lock_guard<std::mutex> hardware_usage_mutex(m_input_hardware_mutex);
+
+	m_clock = clock;
+	m_input_accounting.reset(m_clock());
 }
 
-void CRawInput::reset_hardware_usage_time()
+void CRawInput::on_sampling_mode_changed(bool is_sampling_mode_changed)
 {
-	std::lock_guard<std::mutex> hardware_usage_mutex(m_input_hardware_mutex);
+	// Raw input has to be registered from the thread that owns the input window
+	if (is_sampling_mode_changed && m_window_handle)
+	{
+		::PostMessage(m_window_handle, WM_INPUT_SAMPLING_MODE_CHANGED, 0, 0);
+	}
+}
+
+void CRawInput::write_app_usage_record(uint64_t total_duration)
+{
+	uint64_t record_time = CHRONO_SYSTEM_TIME_SINCE_EPOCH_COUNT;
+
+	CTraceScope serialization_trace_scope("serialize app usage record");
+	std::wstring json_buffer;
+	if (m_recently_used_app_id)
+	{
+		// Every segment has to be readable on its own, so the first record of an app in a segment is preceded by one mapping its id to
+		// its path. Rolling first makes sure both of them end up in the segment we checked.
+		m_file_writer.roll_segment_if_due();
+		if (m_file_writer.get_segment_number() != m_segment_app_ids_segment)
+		{
+			m_segment_app_ids.clear();
+			m_segment_app_ids_segment = m_file_writer.get_segment_number();
+		}
 
-	m_input_hardware_start_time = m_input_hardware_accumulated_time = m_last_accumulated_time = 0;
+		if (m_segment_app_ids.insert(m_recently_used_app_id).second)
+		{
+			json_buffer = L"{\n\n\t \"app_id\" : " + std::to_wstring(m_recently_used_app_id) + L",\n\t \"app_name\" : \"" + m_recently_used_app_path + L"\"\n}\n";
+		}
 
-	// A user could have just scrolled once or moved his mouse once so we check and remove this data cause this data will hamper the 
-	// calculation of total accumulation duration in the next sequence
-	if (!m_mouse_activity.empty()) // There are one or more mouse activity messages
+		json_buffer += L"{\n\n\t \"app_id\" : " + std::to_wstring(m_recently_used_app_id) + L",\n\t \"duration\" : " + std::to_wstring(total_duration) +
+			L",\n\t \"time\" : " + std::to_wstring(record_time) + L"\n}\n";
+	}
+	else
 	{
-		m_mouse_activity.remove(RI_MOUSE_WHEEL);
-		m_mouse_activity.remove(MOUSE_CURSOR_MOVEMENT_MESSAGE);
+		json_buffer = L"{\n\n\t \"app_name\" : \"" + m_recently_used_app_path + L"\",\n\t \"duration\" : " + std::to_wstring(total_duration) +
+			L",\n\t \"time\" : " + std::to_wstring(record_time) + L"\n}\n";
 	}
+	serialization_trace_scope.end();
+
+	m_file_writer.write_data(json_buffer.data(), record_time);
+	m_written_record_count++;
 
-	// Let's accumulate the total duration elapsed from all the inputs
-	uint64_t total_duration = 0;
-	for (const auto &time_elapsed : m_accumulated_input_duration)
+	// Keep the per-app totals of the current day for the live stats
+	time_t record_seconds = static_cast<time_t>(record_time / 1000);
+	tm record_date = { 0 };
+	localtime_s(&record_date, &record_seconds);
+	if (record_date.tm_yday != m_today_day_of_year)
 	{
-		total_duration += time_elapsed;
+		m_today_app_durations.clear();
+		m_today_day_of_year = record_date.tm_yday;
 	}
-	m_accumulated_input_duration.clear(); // Clear this container
-#ifdef _DEBUG
-	::OutputDebugString(std::wstring(L"\n\n\t\t\t**Timer fired. Total duration: " + std::to_wstring(total_duration)).data());
-#endif // _DEBUG
+	m_today_app_durations[m_recently_used_app_path] += total_duration;
+}
+
+void CRawInput::restore_today_app_durations()
+{
+	time_t current_seconds = static_cast<time_t>(CHRONO_SYSTEM_TIME_SINCE_EPOCH_COUNT / 1000);
+	tm today_date = { 0 };
+	localtime_s(&today_date, &current_seconds);
+	m_today_day_of_year = today_date.tm_yday;
 
-	std::wstring json_buffer = L"{\n\n\t \"app_name\" : \"" + m_recently_used_app_path + L"\",\n\t \"duration\" : " + std::to_wstring(total_duration) + L"\n}\n";
-	m_file_writer.write_data(json_buffer.data());
+	today_date.tm_hour = today_date.tm_min = today_date.tm_sec = 0;
+	uint64_t today_start_time = static_cast<uint64_t>(mktime(&today_date)) * 1000;
+
+	m_today_app_durations.clear();
+	CLogCompactor::sum_app_durations(L"app_input_data", m_log_index, today_start_time, m_today_app_durations);
 }
 
 bool CRawInput::create_input_monitor_timer_queue()
@@ -475,18 +579,141 @@ bool CRawInput::create_input_monitor_timer_queue()
 		return false;
 	}
 
+	// Periodically checkpoint the accounting state so that a restart doesn't lose the input duration that hasn't been written yet
+	if (!::CreateTimerQueueTimer(
+			&m_input_monitor_checkpoint_timer,
+			m_input_monitor_timer_queue,
+			checkpoint_timer_routine,
+			nullptr,
+			INPUT_MONITOR_CHECKPOINT_INTERVAL,
+			INPUT_MONITOR_CHECKPOINT_INTERVAL,
+			WT_EXECUTELONGFUNCTION))
+	{
+		return false;
+	}
+
+	if (!::CreateTimerQueueTimer(
+			&m_live_stats_timer,
+			m_input_monitor_timer_queue,
+			live_stats_timer_routine,
+			nullptr,
+			LIVE_STATS_PUBLISH_INTERVAL,
+			LIVE_STATS_PUBLISH_INTERVAL,
+			0))
+	{
+		return false;
+	}
+
 	return true;
 }
 
 void CRawInput::destroy_input_monitor_timer_queue()
 {
-	// Delete timer queue
+	// Delete timer queue and wait for the callbacks that are already running
 	if (m_input_monitor_timer_queue)
 	{
-		::DeleteTimerQueue(m_input_monitor_timer_queue);
+		::DeleteTimerQueueEx(m_input_monitor_timer_queue, INVALID_HANDLE_VALUE);
 		m_input_monitor_timer_queue = nullptr;
 		m_input_monitor_timer_queue_timer = nullptr;
+		m_input_monitor_checkpoint_timer = nullptr;
+		m_live_stats_timer = nullptr;
+		m_input_probe_timer = nullptr;
+	}
+}
+
+void CRawInput::save_checkpoint()
+{
+	TRACE_SCOPE("CRawInput::save_checkpoint");
+
+	// Serialize checkpoint writers so that an older state can never replace a newer one on disk
+	std::lock_guard<std::mutex> checkpoint_mutex(m_checkpoint_mutex);
+
+	SCheckpointState checkpoint_state;
+	{
+		TRACE_LOCK_GUARD(hardware_usage_mutex, m_input_hardware_mutex);
+
+		// The log is only written while holding this lock so its size matches the pending durations captured here
+		checkpoint_state.log_segment = m_file_writer.get_segment_number();
+		checkpoint_state.log_position = m_file_writer.get_segment_size();
+		m_input_accounting.save_checkpoint(checkpoint_state, m_clock());
+		checkpoint_state.app_path = m_recently_used_app_path;
+	}
+
+	if (!m_checkpoint.save(checkpoint_state))
+	{
+		m_checkpoint_failure_count++;
+	}
+}
+
+void CRawInput::publish_live_stats()
+{
+	TRACE_SCOPE("CRawInput::publish_live_stats");
+
+	std::lock_guard<std::mutex> live_stats_mutex(m_live_stats_mutex);
+
+	// Built on the heap as it's too large for the stack of a timer thread
+	std::unique_ptr<SLiveStatsSnapshot> live_stats_snapshot(new SLiveStatsSnapshot());
+	live_stats_snapshot->version = LIVE_STATS_VERSION;
+	live_stats_snapshot->update_time = CHRONO_SYSTEM_TIME_SINCE_EPOCH_COUNT;
+
+	uint64_t current_time = CHRONO_TIME_SINCE_EPOCH_COUNT;
+	{
+		// Only copy the counters while holding the lock, the snapshot is published without it
+		TRACE_LOCK_GUARD(hardware_usage_mutex, m_input_hardware_mutex);
+
+		wcsncpy_s(live_stats_snapshot->current_app_path, m_recently_used_app_path.data(), _TRUNCATE);
+
+		live_stats_snapshot->key_event_count = m_input_accounting.get_key_event_count();
+		live_stats_snapshot->mouse_event_count = m_input_accounting.get_mouse_event_count();
+		live_stats_snapshot->missed_input_event_count = m_input_accounting.get_missed_input_event_count();
+		live_stats_snapshot->written_record_count = m_written_record_count;
+		live_stats_snapshot->log_segment_number = m_file_writer.get_segment_number();
+
+		for (const auto &today_app_duration : m_today_app_durations)
+		{
+			if (live_stats_snapshot->app_count == LIVE_STATS_MAX_APPS)
+			{
+				break;
+			}
+
+			SLiveStatsApp &live_stats_app = live_stats_snapshot->apps[live_stats_snapshot->app_count++];
+			wcsncpy_s(live_stats_app.app_path, today_app_duration.first.data(), _TRUNCATE);
+			live_stats_app.duration_today = today_app_duration.second;
+		}
+	}
+	live_stats_snapshot->checkpoint_failure_count = m_checkpoint_failure_count;
+
+	uint64_t elapsed_time = current_time - m_published_time;
+	if (m_published_time && elapsed_time)
+	{
+		live_stats_snapshot->key_events_per_second = (live_stats_snapshot->key_event_count - m_published_key_event_count) * 1000 / elapsed_time;
+		live_stats_snapshot->mouse_events_per_second = (live_stats_snapshot->mouse_event_count - m_published_mouse_event_count) * 1000 / elapsed_time;
+	}
+	m_published_key_event_count = live_stats_snapshot->key_event_count;
+	m_published_mouse_event_count = live_stats_snapshot->mouse_event_count;
+	m_published_time = current_time;
+
+	m_live_stats_publisher.publish(*live_stats_snapshot);
+}
+
+void CRawInput::restore_checkpoint()
+{
+	SCheckpointState checkpoint_state;
+	if (!m_checkpoint.load(checkpoint_state))
+	{
+		return;
 	}
+
+	TRACE_LOCK_GUARD(hardware_usage_mutex, m_input_hardware_mutex);
+
+	m_recently_used_app_path = checkpoint_state.app_path;
+	m_recently_used_app_id = m_app_identity_table.intern(m_recently_used_app_path);
+
+	m_input_accounting.restore_checkpoint(checkpoint_state, m_file_writer.get_segment_number(), m_file_writer.get_segment_size());
+
+#ifdef _DEBUG
+	::OutputDebugString(std::wstring(L"\n\t**Checkpoint restored. Pending duration: " + std::to_wstring(checkpoint_state.pending_duration)).data());
+#endif // _DEBUG
 }
 
 void CALLBACK queueable_timer_rountine(void *arguments, BYTE timer_or_wait_fired)
@@ -494,5 +721,20 @@ void CALLBACK queueable_timer_rountine(void *arguments, BYTE timer_or_wait_fired
 	g_raw_input->reset_hardware_usage_time();
 }
 
+void CALLBACK checkpoint_timer_routine(void *arguments, BYTE timer_or_wait_fired)
+{
+	g_raw_input->save_checkpoint();
+}
+
+void CALLBACK live_stats_timer_routine(void *arguments, BYTE timer_or_wait_fired)
+{
+	g_raw_input->publish_live_stats();
+}
+
+void CALLBACK input_probe_timer_routine(void *arguments, BYTE timer_or_wait_fired)
+{
+	g_raw_input->probe_input_activity();
+}
+
 CRawInput raw_input;
 CRawInput *g_raw_input = &raw_input;
\ No newline at end of file
@@ -3,13 +3,19 @@
 
 #pragma once
 
-#define INPUT_MONITOR_RESET_THRESHOLD	10 * 1000
-
-#define MOUSE_CURSOR_MOVEMENT_MESSAGE	3000
+#define WM_INPUT_SAMPLING_MODE_CHANGED	(WM_APP + 1) // Posted to the input window to switch raw mouse input on or off
 
 class CFileWriter;
+class CCheckpoint;
+class CLogIndex;
+class CLogCompactor;
+class CLiveStatsPublisher;
+class CAppIdentityTable;
 
 void CALLBACK queueable_timer_rountine(void *arguments, BYTE timer_or_wait_fired);
+void CALLBACK checkpoint_timer_routine(void *arguments, BYTE timer_or_wait_fired);
+void CALLBACK live_stats_timer_routine(void *arguments, BYTE timer_or_wait_fired);
+void CALLBACK input_probe_timer_routine(void *arguments, BYTE timer_or_wait_fired);
 
 class CRawInput
 {
@@ -17,53 +23,98 @@ public:
 	CRawInput(); // Default constructor
 	~CRawInput(); // Destructor
 
-	bool init(HWND window_handle);
+	bool init(HWND window_handle, bool is_adaptive_sampling_enabled = false, bool is_app_identity_table_enabled = false, bool is_input_recorded = false);
 
 	bool read_input_data(LPARAM lparam);
 
+	void on_key_down(uint16_t virtual_key);
+	void on_key_up(uint16_t virtual_key);
 	void on_mouse_activated(uint16_t button_flag);
 	void on_mouse_deactivated(uint16_t button_flag);
-	void on_mouse_wheel_scroll(uint16_t mouse_wheel_flag);
-	void on_mouse_movement(uint16_t mouse_scroll_flag);
+	void on_mouse_wheel_scroll();
+	void on_mouse_movement();
 	void on_app_switched(std::wstring &switched_app_path);
 
-	bool is_keyboard_activity_active() const;
-	bool is_keyboard_activity_inactive() const;
-	bool is_mouse_activity_active() const;
-	bool is_mouse_activity_inactive() const;
+	bool is_keyboard_activity_active();
+	bool is_keyboard_activity_inactive();
+	bool is_mouse_activity_active();
+	bool is_mouse_activity_inactive();
 
 	void reset_hardware_usage_time();
 
+	void save_checkpoint();
+
+	void publish_live_stats();
+
+	void probe_input_activity();
+	void apply_sampling_mode();
+
+	bool check_accounting_invariants();
+
+	uint64_t get_total_accumulated_time();
+	uint64_t get_missed_input_event_count();
+
+	void set_clock(const std::function<uint64_t()> &clock); // Lets the accounting be driven by a simulated clock
+
 private:
 
 	bool create_input_monitor_timer_queue();
 	void destroy_input_monitor_timer_queue();
 
-protected:
+	void restore_checkpoint();
+
+	void on_sampling_mode_changed(bool is_sampling_mode_changed);
 
-	int16_t m_key_down_counter;
-	int16_t m_mouse_activity_counter;
+	bool register_raw_mouse(bool is_registered);
+
+	void record_input_trace(EInputTraceEvent trace_event, uint16_t input_code, uint64_t current_time);
+
+	void write_app_usage_record(uint64_t total_duration);
+	void restore_today_app_durations();
+
+protected:
 
 	HANDLE	m_input_monitor_timer_queue;
 	HANDLE	m_input_monitor_timer_queue_timer;
+	HANDLE	m_input_monitor_checkpoint_timer;
+	HANDLE	m_live_stats_timer;
+	HANDLE	m_input_probe_timer;
+
+	HWND	m_window_handle;
 
 	std::mutex m_input_hardware_mutex;
 
-	std::list<uint16_t> m_keydown_virtual_keys;
-	std::list<uint16_t> m_mouse_activity;
-	std::list<uint16_t> m_duplicate_mouse_activity;
+	CInputAccounting m_input_accounting; // Only accessed while holding the hardware usage mutex
+	std::function<uint64_t()> m_clock; // Milliseconds, only read while holding the hardware usage mutex so that time never goes back
 
-	bool m_keyboard_active;
-	bool m_mouse_active;
+	uint64_t m_written_record_count;
 
-	uint64_t m_input_hardware_start_time, m_input_hardware_accumulated_time;
+	bool m_is_raw_mouse_registered; // Only accessed from the input window thread
 
-	std::list<uint64_t> m_accumulated_input_duration;
-	uint64_t m_last_accumulated_time;
+	std::ofstream m_input_trace_file; // Only open with /record_input, written while holding the hardware usage mutex
+	uint64_t m_input_trace_time; // Time of the last recorded event
 
+	std::map<std::wstring, uint64_t> m_today_app_durations; // Duration written for every app used today
+	int m_today_day_of_year;
+
+	CLogIndex m_log_index;
 	CFileWriter m_file_writer;
+	CLogCompactor m_log_compactor;
+
+	CCheckpoint m_checkpoint;
+	std::mutex m_checkpoint_mutex;
+	std::atomic<uint64_t> m_checkpoint_failure_count;
+
+	CLiveStatsPublisher m_live_stats_publisher;
+	std::mutex m_live_stats_mutex; // Keeps a single writer on the live stats
+	uint64_t m_published_key_event_count, m_published_mouse_event_count, m_published_time;
 
 	std::wstring m_recently_used_app_path;
+
+	CAppIdentityTable m_app_identity_table; // Only open when the app ids are shared with the other monitors on the host
+	uint32_t m_recently_used_app_id; // Zero while the table isn't open
+	std::set<uint32_t> m_segment_app_ids; // App ids whose paths have been written to the current log segment
+	uint32_t m_segment_app_ids_segment;
 };
 
 extern CRawInput *g_raw_input;
\ No newline at end of file
@@ -0,0 +1,126 @@
+//
+//
+
+#include "stdafx.h"
+
+#include "checkpoint.h"
+#include "adaptive_sampling.h"
+#include "input_accounting.h"
+#include "input_trace.h"
+#include "sampling_replay.h"
+
+SAdaptiveSamplingReplay CSamplingReplay::replay(const std::vector<SInputTraceEvent> &trace_events)
+{
+	SAdaptiveSamplingReplay sampling_replay = {};
+	sampling_replay.full_rate = replay_run(trace_events, false);
+	sampling_replay.adaptive = replay_run(trace_events, true);
+
+	return sampling_replay;
+}
+
+SSamplingReplayRun CSamplingReplay::replay_run(const std::vector<SInputTraceEvent> &trace_events, bool is_adaptive_sampling_enabled)
+{
+	SSamplingReplayRun replay_run = {};
+	if (trace_events.empty())
+	{
+		return replay_run;
+	}
+
+	CInputAccounting input_accounting;
+	input_accounting.reset(trace_events.front().event_time);
+	input_accounting.enable_adaptive_sampling(is_adaptive_sampling_enabled);
+
+	// Once the trace is over, the timer keeps firing until even held input has gone stale
+	const uint64_t end_time = trace_events.back().event_time + INPUT_MONITOR_RESET_THRESHOLD + INPUT_POINTER_IDLE_GAP;
+
+	uint64_t next_timer_time = trace_events.front().event_time + INPUT_MONITOR_RESET_THRESHOLD, next_probe_time = UINT64_MAX, last_input_time = 0;
+	uint16_t held_button_flags = 0; // What GetAsyncKeyState would tell the probe
+	auto on_sampling_mode_changed = [&](bool is_sampling_mode_changed, uint64_t current_time)
+	{
+		if (is_sampling_mode_changed)
+		{
+			// The probe only runs while throttled
+			replay_run.mode_switch_count++;
+			next_probe_time = input_accounting.is_probing() ? current_time + ADAPTIVE_SAMPLING_PROBE_INTERVAL : UINT64_MAX;
+		}
+	};
+
+	for (size_t event_index = 0; event_index <= trace_events.size(); event_index++)
+	{
+		bool is_trace_over = event_index == trace_events.size();
+		uint64_t event_time = is_trace_over ? end_time : trace_events[event_index].event_time;
+
+		// The timer and the probes that fire before this input
+		while (std::min(next_timer_time, next_probe_time) <= event_time)
+		{
+			replay_run.wakeup_count++;
+
+			if (next_probe_time < next_timer_time)
+			{
+				uint64_t probe_time = next_probe_time;
+				next_probe_time += ADAPTIVE_SAMPLING_PROBE_INTERVAL;
+				on_sampling_mode_changed(input_accounting.on_input_probe(probe_time, last_input_time, held_button_flags), probe_time);
+			}
+			else
+			{
+				replay_run.active_time += input_accounting.collect_input_duration(next_timer_time);
+				next_timer_time += INPUT_MONITOR_RESET_THRESHOLD;
+			}
+		}
+
+		if (is_trace_over)
+		{
+			break;
+		}
+
+		// Every input counts as the last input, but only the keyboard is still registered while throttled
+		const SInputTraceEvent &trace_event = trace_events[event_index];
+		last_input_time = trace_event.event_time;
+		if (trace_event.trace_event == EInputTraceEvent::button_down)
+		{
+			held_button_flags |= trace_event.input_code;
+		}
+		else if (trace_event.trace_event == EInputTraceEvent::button_up)
+		{
+			held_button_flags &= ~trace_event.input_code;
+		}
+		if (input_accounting.is_probing() && trace_event.trace_event != EInputTraceEvent::key_down && trace_event.trace_event != EInputTraceEvent::key_up)
+		{
+			continue;
+		}
+
+		replay_run.wakeup_count++;
+
+		switch (trace_event.trace_event)
+		{
+		case EInputTraceEvent::key_down:
+			on_sampling_mode_changed(input_accounting.on_key_down(trace_event.input_code, event_time), event_time);
+			break;
+
+		case EInputTraceEvent::key_up:
+			input_accounting.on_key_up(trace_event.input_code, event_time);
+			break;
+
+		case EInputTraceEvent::button_down:
+			on_sampling_mode_changed(input_accounting.on_mouse_activated(trace_event.input_code, event_time), event_time);
+			break;
+
+		case EInputTraceEvent::button_up:
+			input_accounting.on_mouse_deactivated(trace_event.input_code, event_time);
+			break;
+
+		case EInputTraceEvent::mouse_wheel:
+			on_sampling_mode_changed(input_accounting.on_mouse_wheel_scroll(event_time), event_time);
+			break;
+
+		case EInputTraceEvent::mouse_movement:
+			on_sampling_mode_changed(input_accounting.on_mouse_movement(event_time), event_time);
+			break;
+		}
+	}
+
+	replay_run.active_time += input_accounting.collect_input_duration(end_time);
+	replay_run.missed_input_event_count = input_accounting.get_missed_input_event_count();
+
+	return replay_run;
+}
\ No newline at end of file
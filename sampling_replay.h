@@ -0,0 +1,30 @@
+//
+//
+
+#pragma once
+
+struct SSamplingReplayRun
+{
+	uint64_t wakeup_count; // Raw input messages received plus the timer and probe callbacks
+	uint64_t active_time; // Input duration written to the log, in milliseconds
+	uint64_t missed_input_event_count;
+	uint64_t mode_switch_count;
+};
+
+struct SAdaptiveSamplingReplay
+{
+	SSamplingReplayRun full_rate, adaptive;
+};
+
+// Replays an input trace through CInputAccounting the way CRawInput drives it, once receiving every report and once with adaptive
+// sampling, so that the wakeups and the measured totals of both can be compared. While throttled no mouse report is received, buttons
+// included, and the probe sees the time of the last input of any kind and the buttons that are down, as GetLastInputInfo and
+// GetAsyncKeyState do. A mode change takes effect right away while the monitor applies it a message later on its input window thread.
+class CSamplingReplay
+{
+public:
+	static SAdaptiveSamplingReplay replay(const std::vector<SInputTraceEvent> &trace_events);
+
+private:
+	static SSamplingReplayRun replay_run(const std::vector<SInputTraceEvent> &trace_events, bool is_adaptive_sampling_enabled);
+};
\ No newline at end of file
@@ -0,0 +1,207 @@
+//
+//
+
+#include "stdafx.h"
+
+#include "shared_memory.h"
+
+CSharedMemory::CSharedMemory()
+{
+#ifdef _WIN32
+	m_mapping_handle = nullptr;
+#endif // _WIN32
+	m_address = nullptr;
+	m_size = 0;
+}
+
+CSharedMemory::~CSharedMemory()
+{
+	close();
+}
+
+#ifdef _WIN32
+bool CSharedMemory::create(const wchar_t *name, size_t size, bool is_shared_with_all_users)
+{
+	// Without a security descriptor the mapping gets the default DACL of the creator, which keeps the users of other sessions out
+	SECURITY_ATTRIBUTES security_attributes = { 0 };
+	security_attributes.nLength = sizeof(security_attributes);
+	if (is_shared_with_all_users &&
+		!::ConvertStringSecurityDescriptorToSecurityDescriptorW(SHARED_MEMORY_ALL_USERS_SDDL, SDDL_REVISION_1, &security_attributes.lpSecurityDescriptor, nullptr))
+	{
+		return false;
+	}
+
+	m_mapping_handle = ::CreateFileMappingW(INVALID_HANDLE_VALUE, is_shared_with_all_users ? &security_attributes : nullptr, PAGE_READWRITE,
+		static_cast<DWORD>(static_cast<uint64_t>(size) >> 32), static_cast<DWORD>(size), name);
+
+	if (security_attributes.lpSecurityDescriptor)
+	{
+		::LocalFree(security_attributes.lpSecurityDescriptor);
+	}
+
+	if (!m_mapping_handle)
+	{
+		return false;
+	}
+
+	m_size = size;
+
+	return map_view(FILE_MAP_ALL_ACCESS);
+}
+
+bool CSharedMemory::open(const wchar_t *name, size_t size, bool is_writable)
+{
+	// Only read and write, which is all the users a mapping is shared with are granted
+	DWORD desired_access = is_writable ? FILE_MAP_READ | FILE_MAP_WRITE : FILE_MAP_READ;
+
+	m_mapping_handle = ::OpenFileMappingW(desired_access, FALSE, name);
+	if (!m_mapping_handle)
+	{
+		return false;
+	}
+
+	m_size = size;
+
+	return map_view(desired_access);
+}
+
+void CSharedMemory::close()
+{
+	if (m_address)
+	{
+		::UnmapViewOfFile(m_address);
+		m_address = nullptr;
+	}
+
+	if (m_mapping_handle)
+	{
+		::CloseHandle(m_mapping_handle);
+		m_mapping_handle = nullptr;
+	}
+}
+
+void CSharedMemory::remove(const wchar_t *name)
+{
+
+}
+
+bool CSharedMemory::map_view(DWORD desired_access)
+{
+	m_address = ::MapViewOfFile(m_mapping_handle, desired_access, 0, 0, m_size);
+	if (!m_address)
+	{
+		close();
+		return false;
+	}
+
+	return true;
+}
+#else
+bool CSharedMemory::create(const wchar_t *name, size_t size, bool is_shared_with_all_users)
+{
+	mode_t object_mode = is_shared_with_all_users ? 0666 : 0600;
+
+	bool is_created = true;
+	int object_descriptor = ::shm_open(get_object_name(name).data(), O_CREAT | O_EXCL | O_RDWR, object_mode);
+	if (object_descriptor == -1 && errno == EEXIST)
+	{
+		is_created = false;
+		object_descriptor = ::shm_open(get_object_name(name).data(), O_RDWR, 0);
+	}
+	if (object_descriptor == -1)
+	{
+		return false;
+	}
+
+	// The mode was masked by the umask
+	if (is_created && ::fchmod(object_descriptor, object_mode) == -1)
+	{
+		::close(object_descriptor);
+		return false;
+	}
+
+	// Growing a new object zero fills it, an existing one of this size is left alone
+	struct stat object_status = {};
+	if (::fstat(object_descriptor, &object_status) == -1 || (static_cast<size_t>(object_status.st_size) < size && ::ftruncate(object_descriptor, size) == -1))
+	{
+		::close(object_descriptor);
+		return false;
+	}
+
+	m_size = size;
+
+	return map_object(object_descriptor, true);
+}
+
+bool CSharedMemory::open(const wchar_t *name, size_t size, bool is_writable)
+{
+	int object_descriptor = ::shm_open(get_object_name(name).data(), is_writable ? O_RDWR : O_RDONLY, 0);
+	if (object_descriptor == -1)
+	{
+		return false;
+	}
+
+	// Mapping past the end of a smaller object would fault on access instead of failing here
+	struct stat object_status = {};
+	if (::fstat(object_descriptor, &object_status) == -1 || static_cast<size_t>(object_status.st_size) < size)
+	{
+		::close(object_descriptor);
+		return false;
+	}
+
+	m_size = size;
+
+	return map_object(object_descriptor, is_writable);
+}
+
+void CSharedMemory::close()
+{
+	if (m_address)
+	{
+		::munmap(m_address, m_size);
+		m_address = nullptr;
+	}
+}
+
+void CSharedMemory::remove(const wchar_t *name)
+{
+	::shm_unlink(get_object_name(name).data());
+}
+
+std::string CSharedMemory::get_object_name(const wchar_t *name)
+{
+	std::wstring mapping_name = name;
+	mapping_name = mapping_name.substr(mapping_name.find(L'\\') + 1);
+
+	// Object names are ASCII
+	std::string object_name = "/";
+	for (const auto &name_character : mapping_name)
+	{
+		object_name += static_cast<char>(name_character);
+	}
+
+	return object_name;
+}
+
+bool CSharedMemory::map_object(int object_descriptor, bool is_writable)
+{
+	void *address = ::mmap(nullptr, m_size, is_writable ? PROT_READ | PROT_WRITE : PROT_READ, MAP_SHARED, object_descriptor, 0);
+
+	// The mapping keeps the object alive without its descriptor
+	::close(object_descriptor);
+
+	if (address == MAP_FAILED)
+	{
+		return false;
+	}
+
+	m_address = address;
+
+	return true;
+}
+#endif // _WIN32
+
+void *CSharedMemory::get_address() const
+{
+	return m_address;
+}
\ No newline at end of file
@@ -0,0 +1,38 @@
+//
+//
+
+#pragma once
+
+// Full access for the system and the administrators, read and write for every signed in user
+#define SHARED_MEMORY_ALL_USERS_SDDL	L"D:(A;;GA;;;SY)(A;;GA;;;BA)(A;;GRGW;;;AU)"
+
+// Named memory shared between processes. On Windows it's a file mapping backed by the paging file, elsewhere it's a POSIX shared memory
+// object named after the part of the name that follows the Local\ or Global\ namespace. The memory is zero filled when it's created.
+class CSharedMemory
+{
+public:
+	CSharedMemory();
+	~CSharedMemory();
+
+	bool create(const wchar_t *name, size_t size, bool is_shared_with_all_users = false); // Opens the memory instead if it already exists
+	bool open(const wchar_t *name, size_t size, bool is_writable);
+	void close();
+
+	void *get_address() const;
+
+	static void remove(const wchar_t *name); // A POSIX object outlives its processes, a file mapping is gone with its last handle
+
+private:
+#ifdef _WIN32
+	bool map_view(DWORD desired_access);
+
+	HANDLE m_mapping_handle;
+#else
+	static std::string get_object_name(const wchar_t *name);
+
+	bool map_object(int object_descriptor, bool is_writable);
+#endif // _WIN32
+
+	void *m_address;
+	size_t m_size;
+};
\ No newline at end of file
@@ -7,6 +7,8 @@
 
 #include <memory>
 
+#include <functional>
+
 #include <string>
 
 #include <chrono>
@@ -15,14 +17,56 @@
 
 #include <mutex>
 
+#include <thread>
+
+#include <condition_variable>
+
 #include <list>
 
 #include <map>
 
+#include <set>
+
 #include <vector>
 
 #include <algorithm>
 
+#include <random>
+
 #include <fstream>
 
-#include <Windows.h>
\ No newline at end of file
+#include <sstream>
+
+#include <iomanip>
+
+#include <iterator>
+
+#include <ctime>
+
+#ifdef _WIN32
+#include <Windows.h>
+#include <sddl.h>
+#else
+#include <cstring>
+#include <cstddef>
+#include <cerrno>
+#include <cwchar>
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <fnmatch.h>
+
+// What the modules tested on other platforms use from Windows.h and the secure CRT
+#define MAX_PATH			260
+
+#define YieldProcessor()	std::this_thread::yield()
+
+#define swprintf_s(buffer, format, ...)	swprintf(buffer, sizeof(buffer) / sizeof(*(buffer)), format, __VA_ARGS__)
+#define localtime_s(result, time)		localtime_r(time, result)
+
+typedef unsigned char byte;
+typedef uint32_t DWORD;
+#endif // _WIN32
\ No newline at end of file
@@ -0,0 +1,208 @@
+//
+//
+
+#include "stdafx.h"
+
+#include "log_index.h"
+#include "file_writer.h"
+#include "log_compactor.h"
+#include "checkpoint.h"
+#include "shared_memory.h"
+#include "live_stats.h"
+#include "app_identity_table.h"
+#include "adaptive_sampling.h"
+#include "input_accounting.h"
+#include "input_trace.h"
+#include "raw_input.h"
+#include "stress_generator.h"
+
+namespace
+{
+	constexpr uint16_t stress_virtual_keys[] = { 0x10, 0x11, 0x12, 0x41, 0x42, 0x43, 0x44, 0x45 };
+
+	constexpr uint64_t stress_start_time = 1000; // Simulated milliseconds, a span never starts at zero
+
+	constexpr uint16_t stress_mouse_buttons[] = { RI_MOUSE_LEFT_BUTTON_DOWN, RI_MOUSE_MIDDLE_BUTTON_DOWN, RI_MOUSE_RIGHT_BUTTON_DOWN };
+
+	const wchar_t *stress_app_paths[] = { L"C:\\Windows\\explorer.exe", L"C:\\Windows\\notepad.exe", L"C:\\Program Files\\app\\app.exe" };
+
+	enum class EStressEvent
+	{
+		key_down,
+		key_up,
+		button_down,
+		button_up,
+		mouse_wheel,
+		mouse_movement,
+		app_switch,
+		timer,
+	};
+
+	// Relative frequency of every event, app switches and timer ticks are rare compared to raw input
+	EStressEvent pick_stress_event(uint32_t random_number)
+	{
+		uint32_t event_weight = random_number % 10000;
+		if (event_weight < 1500) return EStressEvent::key_down;
+		if (event_weight < 3000) return EStressEvent::key_up;
+		if (event_weight < 4000) return EStressEvent::button_down;
+		if (event_weight < 5000) return EStressEvent::button_up;
+		if (event_weight < 6000) return EStressEvent::mouse_wheel;
+		if (event_weight < 9990) return EStressEvent::mouse_movement;
+		if (event_weight < 9995) return EStressEvent::app_switch;
+		return EStressEvent::timer;
+	}
+}
+
+CStressGenerator::CStressGenerator()
+{
+	m_is_stopping = false;
+	m_event_count = 0;
+	m_invariant_check_count = m_invariant_violation_count = 0;
+	m_simulated_time = stress_start_time;
+}
+
+CStressGenerator::~CStressGenerator()
+{
+
+}
+
+SStressResult CStressGenerator::run(uint32_t producer_count, uint64_t duration, uint32_t drop_percent, uint32_t duplicate_percent)
+{
+	// The accounting core under test is never initialized so it neither registers devices nor writes any data
+	std::unique_ptr<CRawInput> raw_input(new CRawInput);
+
+	m_is_stopping = false;
+	m_event_count = 0;
+	m_invariant_check_count = m_invariant_violation_count = 0;
+
+	// Every event advances a simulated clock by a millisecond, so the timer driven parts of the accounting can be reached without waiting
+	m_simulated_time = stress_start_time;
+	raw_input->set_clock([this]() { return m_simulated_time.load(); });
+
+	auto start_time = std::chrono::steady_clock::now();
+
+	std::vector<std::thread> producer_threads;
+	for (uint32_t producer_index = 0; producer_index < producer_count; producer_index++)
+	{
+		producer_threads.emplace_back(&CStressGenerator::producer_thread, this, raw_input.get(), producer_index + 1, drop_percent, duplicate_percent);
+	}
+	std::thread invariant_checker(&CStressGenerator::invariant_checker_thread, this, raw_input.get());
+
+	std::this_thread::sleep_for(std::chrono::milliseconds(duration));
+	m_is_stopping = true;
+
+	for (auto &producer_thread : producer_threads)
+	{
+		producer_thread.join();
+	}
+	invariant_checker.join();
+
+	auto elapsed_time = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start_time).count();
+
+	uint64_t missed_input_event_count = raw_input->get_missed_input_event_count();
+
+	// Nothing is released by hand: the keys and buttons whose release was dropped, and the duplicated button downs, have to be drained
+	// by the timer once the input has been idle for the reset threshold, as they would be in the monitor
+	m_simulated_time += INPUT_MONITOR_RESET_THRESHOLD;
+	raw_input->reset_hardware_usage_time();
+
+	SStressResult stress_result = {};
+	stress_result.event_count = m_event_count;
+	stress_result.elapsed_time = static_cast<uint64_t>(elapsed_time);
+	stress_result.events_per_second = elapsed_time ? stress_result.event_count * 1000 / elapsed_time : 0;
+	stress_result.invariant_check_count = m_invariant_check_count + 1;
+	stress_result.invariant_violation_count = m_invariant_violation_count + (raw_input->check_accounting_invariants() ? 0 : 1);
+	stress_result.accumulated_time = raw_input->get_total_accumulated_time();
+	stress_result.missed_input_event_count = missed_input_event_count;
+	stress_result.is_drained = raw_input->is_keyboard_activity_inactive() && raw_input->is_mouse_activity_inactive();
+	stress_result.drained_input_event_count = raw_input->get_missed_input_event_count() - missed_input_event_count;
+
+	return stress_result;
+}
+
+void CStressGenerator::producer_thread(CRawInput *raw_input, uint32_t seed, uint32_t drop_percent, uint32_t duplicate_percent)
+{
+	std::mt19937 random_generator(seed);
+
+	uint64_t event_count = 0;
+	while (!m_is_stopping.load(std::memory_order_relaxed))
+	{
+		uint32_t random_number = random_generator();
+		EStressEvent stress_event = pick_stress_event(random_number);
+
+		uint16_t virtual_key = stress_virtual_keys[(random_number >> 16) % _countof(stress_virtual_keys)];
+		uint16_t mouse_button = stress_mouse_buttons[(random_number >> 16) % _countof(stress_mouse_buttons)];
+
+		uint32_t fault_number = random_generator() % 100;
+		bool is_dropped = fault_number < drop_percent && (stress_event == EStressEvent::key_up || stress_event == EStressEvent::button_up);
+		uint32_t delivery_count = is_dropped ? 0 : (fault_number >= 100 - duplicate_percent ? 2 : 1);
+
+		m_simulated_time++;
+
+		for (uint32_t delivery_index = 0; delivery_index < delivery_count; delivery_index++)
+		{
+			switch (stress_event)
+			{
+			case EStressEvent::key_down:
+				raw_input->on_key_down(virtual_key);
+				break;
+
+			case EStressEvent::key_up:
+				raw_input->on_key_up(virtual_key);
+				break;
+
+			case EStressEvent::button_down:
+				raw_input->on_mouse_activated(mouse_button);
+				break;
+
+			case EStressEvent::button_up:
+				raw_input->on_mouse_deactivated(mouse_button);
+				break;
+
+			case EStressEvent::mouse_wheel:
+				raw_input->on_mouse_wheel_scroll();
+				break;
+
+			case EStressEvent::mouse_movement:
+				raw_input->on_mouse_movement();
+				break;
+
+			case EStressEvent::app_switch:
+				{
+					std::wstring app_path = stress_app_paths[(random_number >> 16) % _countof(stress_app_paths)];
+					raw_input->on_app_switched(app_path);
+				}
+				break;
+
+			case EStressEvent::timer:
+				raw_input->reset_hardware_usage_time();
+				break;
+			}
+
+			event_count++;
+		}
+
+		// Keep the shared counter off the hot path
+		if (event_count >= 4096)
+		{
+			m_event_count.fetch_add(event_count, std::memory_order_relaxed);
+			event_count = 0;
+		}
+	}
+
+	m_event_count.fetch_add(event_count, std::memory_order_relaxed);
+}
+
+void CStressGenerator::invariant_checker_thread(CRawInput *raw_input)
+{
+	while (!m_is_stopping.load(std::memory_order_relaxed))
+	{
+		if (!raw_input->check_accounting_invariants())
+		{
+			m_invariant_violation_count++;
+		}
+		m_invariant_check_count++;
+
+		std::this_thread::sleep_for(std::chrono::milliseconds(STRESS_INVARIANT_CHECK_INTERVAL));
+	}
+}
\ No newline at end of file
@@ -0,0 +1,49 @@
+//
+//
+
+#pragma once
+
+#define STRESS_PRODUCER_COUNT		4
+
+#define STRESS_DURATION				10 * 1000 // Milliseconds
+
+#define STRESS_DROP_PERCENT			1 // Percentage of key and button releases that are never delivered
+
+#define STRESS_DUPLICATE_PERCENT	1 // Percentage of events that are delivered twice
+
+#define STRESS_INVARIANT_CHECK_INTERVAL	10 // Milliseconds
+
+class CRawInput;
+
+struct SStressResult
+{
+	uint64_t event_count;
+	uint64_t elapsed_time; // Milliseconds
+	uint64_t events_per_second;
+	uint64_t invariant_check_count, invariant_violation_count;
+	uint64_t accumulated_time; // Input time accumulated by the accounting core, in milliseconds
+	uint64_t missed_input_event_count;
+	uint64_t drained_input_event_count; // Keys and buttons still held once every producer stopped, released by the timer
+	bool is_drained; // No key or mouse activity remained once the timer fired after the input had been idle for the reset threshold
+};
+
+// Drives the accounting core of CRawInput with randomized, interleaved key, button, wheel, movement, app switch and timer events from
+// several producer threads, injecting dropped and duplicated events, while checking the accounting invariants
+class CStressGenerator
+{
+public:
+	CStressGenerator();
+	~CStressGenerator();
+
+	SStressResult run(uint32_t producer_count = STRESS_PRODUCER_COUNT, uint64_t duration = STRESS_DURATION,
+		uint32_t drop_percent = STRESS_DROP_PERCENT, uint32_t duplicate_percent = STRESS_DUPLICATE_PERCENT);
+
+private:
+	void producer_thread(CRawInput *raw_input, uint32_t seed, uint32_t drop_percent, uint32_t duplicate_percent);
+	void invariant_checker_thread(CRawInput *raw_input);
+
+	std::atomic<bool> m_is_stopping;
+	std::atomic<uint64_t> m_event_count;
+	std::atomic<uint64_t> m_invariant_check_count, m_invariant_violation_count;
+	std::atomic<uint64_t> m_simulated_time; // Milliseconds
+};
\ No newline at end of file
@@ -0,0 +1,227 @@
+//
+//
+
+#include "stdafx.h"
+
+#include "shared_memory.h"
+#include "app_identity_table.h"
+
+#include <sys/wait.h>
+
+// Monitor processes intern overlapping sets of app paths at the same time and in the same order, so that they keep racing to insert the
+// same path, through the table a host process created. Every process has to get the same id for a path, no two paths may share an id, and every id has to resolve to its path.
+
+namespace
+{
+	constexpr uint32_t monitor_count = 4;
+	constexpr uint32_t app_path_count = 12000;
+	constexpr uint32_t monitor_app_path_count = 9000; // Out of the app path count, so the sets overlap
+
+	std::wstring get_app_path(uint32_t app_path_index)
+	{
+		return L"C:\\Program Files\\App " + std::to_wstring(app_path_index) + L"\\app_" + std::to_wstring(app_path_index * 7919 % app_path_count) + L".exe";
+	}
+
+	int run_monitor(const std::wstring &mapping_name, uint32_t monitor_index, int start_descriptor, int result_descriptor)
+	{
+		CAppIdentityTable app_identity_table;
+		if (!app_identity_table.init(mapping_name.data()))
+		{
+			std::cout << "FAILED: monitor " << monitor_index << " can't open the table" << std::endl;
+			return 1;
+		}
+
+		std::vector<uint32_t> app_path_indexes(app_path_count);
+		for (uint32_t app_path_index = 0; app_path_index < app_path_count; app_path_index++)
+		{
+			app_path_indexes[app_path_index] = app_path_index;
+		}
+		std::mt19937 random_generator(monitor_index + 1);
+		std::shuffle(app_path_indexes.begin(), app_path_indexes.end(), random_generator);
+		app_path_indexes.resize(monitor_app_path_count);
+		std::sort(app_path_indexes.begin(), app_path_indexes.end());
+
+		// Wait for the other monitors, the start pipe is closed once they're all forked
+		char start_signal = 0;
+		if (::read(start_descriptor, &start_signal, 1) != 0)
+		{
+			return 1;
+		}
+
+		// Zero for the paths this monitor didn't intern
+		std::vector<uint32_t> app_ids(app_path_count);
+		for (uint32_t app_path_index : app_path_indexes)
+		{
+			app_ids[app_path_index] = app_identity_table.intern(get_app_path(app_path_index));
+			if (!app_ids[app_path_index])
+			{
+				std::cout << "FAILED: monitor " << monitor_index << " got no id for path " << app_path_index << std::endl;
+				return 1;
+			}
+		}
+
+		// Interning again and looking up have to give the ids back
+		for (uint32_t app_path_index : app_path_indexes)
+		{
+			if (app_identity_table.intern(get_app_path(app_path_index)) != app_ids[app_path_index] ||
+				app_identity_table.find(get_app_path(app_path_index)) != app_ids[app_path_index])
+			{
+				std::cout << "FAILED: monitor " << monitor_index << " got another id for path " << app_path_index << std::endl;
+				return 1;
+			}
+		}
+
+		size_t result_size = app_ids.size() * sizeof(app_ids[0]);
+		return ::write(result_descriptor, app_ids.data(), result_size) == static_cast<ssize_t>(result_size) ? 0 : 1;
+	}
+
+	bool is_shared_with_all_users(const std::wstring &mapping_name)
+	{
+		// Where Linux keeps the POSIX shared memory objects
+		std::string object_path = "/dev/shm/";
+		for (const auto &name_character : mapping_name.substr(mapping_name.find(L'\\') + 1))
+		{
+			object_path += static_cast<char>(name_character);
+		}
+
+		struct stat object_status = {};
+		return ::stat(object_path.data(), &object_status) == 0 && (object_status.st_mode & 0777) == 0666;
+	}
+}
+
+int main()
+{
+	std::wstring mapping_name = L"Global\\AppInputMonitorAppIdentitiesTest" + std::to_wstring(::getpid());
+	CSharedMemory::remove(mapping_name.data());
+
+	uint32_t failure_count = 0;
+
+	// The monitors don't start without the table
+	CAppIdentityTable missing_app_identity_table;
+	if (missing_app_identity_table.init(mapping_name.data()))
+	{
+		std::cout << "FAILED: a monitor opened a table nobody created" << std::endl;
+		failure_count++;
+	}
+
+	CAppIdentityTable host_app_identity_table;
+	if (!host_app_identity_table.create(mapping_name.data()))
+	{
+		std::cout << "FAILED: the host can't create the table" << std::endl;
+		return 1;
+	}
+
+	// Not only the user that started the host may open it, whatever the umask
+	if (!is_shared_with_all_users(mapping_name))
+	{
+		std::cout << "FAILED: the table isn't shared with all users" << std::endl;
+		failure_count++;
+	}
+
+	int start_descriptors[2] = { -1, -1 };
+	if (::pipe(start_descriptors) == -1)
+	{
+		std::cout << "FAILED: can't create a pipe" << std::endl;
+		return 1;
+	}
+
+	std::vector<pid_t> process_ids;
+	std::vector<int> result_descriptors;
+	for (uint32_t monitor_index = 0; monitor_index < monitor_count; monitor_index++)
+	{
+		int pipe_descriptors[2] = { -1, -1 };
+		if (::pipe(pipe_descriptors) == -1)
+		{
+			std::cout << "FAILED: can't create a pipe" << std::endl;
+			return 1;
+		}
+
+		pid_t process_id = ::fork();
+		if (process_id == 0)
+		{
+			::close(pipe_descriptors[0]);
+			::close(start_descriptors[1]);
+			::_exit(run_monitor(mapping_name, monitor_index, start_descriptors[0], pipe_descriptors[1]));
+		}
+		::close(pipe_descriptors[1]);
+
+		process_ids.push_back(process_id);
+		result_descriptors.push_back(pipe_descriptors[0]);
+	}
+
+	::close(start_descriptors[0]);
+	::close(start_descriptors[1]);
+
+	// Read before waiting, a monitor blocks on a full pipe until its result is read
+	std::vector<std::vector<uint32_t>> monitor_app_ids(monitor_count, std::vector<uint32_t>(app_path_count));
+	for (uint32_t monitor_index = 0; monitor_index < monitor_count; monitor_index++)
+	{
+		byte *result = reinterpret_cast<byte *>(monitor_app_ids[monitor_index].data());
+		size_t result_size = app_path_count * sizeof(uint32_t), read_size = 0;
+		while (read_size < result_size)
+		{
+			ssize_t chunk_size = ::read(result_descriptors[monitor_index], result + read_size, result_size - read_size);
+			if (chunk_size <= 0)
+			{
+				break;
+			}
+			read_size += chunk_size;
+		}
+		::close(result_descriptors[monitor_index]);
+	}
+
+	for (pid_t process_id : process_ids)
+	{
+		int process_status = 0;
+		if (process_id == -1 || ::waitpid(process_id, &process_status, 0) == -1 || !WIFEXITED(process_status) || WEXITSTATUS(process_status) != 0)
+		{
+			failure_count++;
+		}
+	}
+
+	uint32_t disagreement_count = 0, shared_id_count = 0, unresolved_id_count = 0, interned_path_count = 0;
+	std::map<uint32_t, uint32_t> app_path_indexes; // By app id
+	for (uint32_t app_path_index = 0; app_path_index < app_path_count; app_path_index++)
+	{
+		uint32_t app_id = 0;
+		for (uint32_t monitor_index = 0; monitor_index < monitor_count; monitor_index++)
+		{
+			uint32_t monitor_app_id = monitor_app_ids[monitor_index][app_path_index];
+			if (monitor_app_id && app_id && monitor_app_id != app_id)
+			{
+				disagreement_count++;
+			}
+			app_id = app_id ? app_id : monitor_app_id;
+		}
+
+		if (!app_id)
+		{
+			continue; // No monitor interned this path
+		}
+		interned_path_count++;
+
+		if (!app_path_indexes.insert(std::make_pair(app_id, app_path_index)).second)
+		{
+			shared_id_count++;
+		}
+
+		std::wstring app_path;
+		if (!host_app_identity_table.get_app_path(app_id, app_path) || app_path != get_app_path(app_path_index) ||
+			host_app_identity_table.find(app_path) != app_id)
+		{
+			unresolved_id_count++;
+		}
+	}
+
+	host_app_identity_table.close();
+	CSharedMemory::remove(mapping_name.data());
+
+	std::cout << monitor_count << " monitors interned " << interned_path_count << " paths: " << disagreement_count << " disagreements, " << shared_id_count <<
+		" shared ids, " << unresolved_id_count << " unresolved ids" << std::endl;
+
+	failure_count += disagreement_count + shared_id_count + unresolved_id_count;
+
+	std::cout << (failure_count ? "FAILED" : "PASSED") << std::endl;
+
+	return failure_count ? 1 : 0;
+}
\ No newline at end of file
@@ -0,0 +1,807 @@
+//
+//
+
+#include "stdafx.h"
+
+#include "file_system.h"
+#include "log_index.h"
+#include "file_writer.h"
+#include "log_compactor.h"
+#include "checkpoint.h"
+#include "adaptive_sampling.h"
+#include "input_accounting.h"
+
+#include <sys/wait.h>
+#include <signal.h>
+
+// Replays randomized input sessions through the accounting while killing the monitor at random points, either abruptly or after a final
+// checkpoint, and restarting it from the last checkpoint and the log. Every kill is checked against an uninterrupted run of the same
+// session: no time may be counted twice, and the only time a kill may lose is what a restarted monitor can't know about, which is the
+// input since the last checkpoint and the input that is still held when it restarts.
+//
+// The kills are first simulated in memory, many times over, and then done for real: a monitor process writes the log and the checkpoint
+// files and gets SIGKILL at random points, the next one restarts from what is on disk, sometimes after the checkpoint was torn.
+
+namespace
+{
+	constexpr uint64_t session_start_time = 1000;
+	constexpr uint64_t session_duration = 15 * 60 * 1000;
+
+	constexpr uint32_t session_count = 8;
+	constexpr uint32_t kill_trial_count = 40; // For every session
+	constexpr uint32_t max_kill_count = 6; // For every trial
+	constexpr uint64_t max_downtime = 5000; // The input while the monitor is down is never seen
+
+	constexpr uint32_t process_session_count = 3;
+	constexpr uint32_t process_kill_count = 12; // For every session
+	constexpr uint32_t torn_checkpoint_percent = 25; // Restarts that find the checkpoint torn
+	constexpr uint64_t test_segment_size = 8 * 1024; // Small so that the kills also land around segment rolls
+	constexpr auto monitor_timeout = std::chrono::seconds(120);
+
+	constexpr uint16_t test_mouse_buttons[] = { 0x0001, 0x0004, 0x0010 }; // RI_MOUSE_LEFT_BUTTON_DOWN, RIGHT and MIDDLE
+
+	enum class ETestEvent
+	{
+		key_down,
+		key_up,
+		button_down,
+		button_up,
+		mouse_wheel,
+		mouse_movement,
+		app_switch,
+		timer,
+		checkpoint,
+	};
+
+	struct STestEvent
+	{
+		uint64_t event_time;
+		ETestEvent test_event;
+		uint16_t input_code;
+	};
+
+	// What survives a kill besides the checkpoint
+	struct STestLog
+	{
+		uint64_t total_duration;
+		uint64_t record_count; // Stands in for the size of the segment
+	};
+
+	// The uninterrupted run, with the time it has accounted for after every event whether logged or not, and the part of it that's logged
+	struct SReferenceRun
+	{
+		std::vector<uint64_t> accounted_times, logged_times;
+		std::vector<bool> idle_events;
+		uint64_t duration;
+	};
+
+	// Written by a monitor process as it goes, so it tells how far the monitor got when it was killed
+	struct SMonitorProgress
+	{
+		std::atomic<uint64_t> event_count; // Events applied completely
+		std::atomic<uint64_t> checkpoint_event_count; // Events applied when the checkpoint on disk was saved, zero for none
+		std::atomic<uint64_t> logged_event_count; // Events applied when the last record was written
+		std::atomic<bool> is_finished;
+	};
+
+	uint32_t g_failure_count = 0;
+
+	void check(bool condition, const std::string &description)
+	{
+		if (!condition)
+		{
+			std::cout << "FAILED: " << description << std::endl;
+			g_failure_count++;
+		}
+	}
+
+	std::vector<STestEvent> generate_session(uint32_t seed)
+	{
+		std::mt19937 random_generator(seed);
+		auto random_between = [&random_generator](uint64_t minimum, uint64_t maximum) { return minimum + random_generator() % (maximum - minimum + 1); };
+
+		std::vector<STestEvent> test_events;
+		const uint64_t session_end_time = session_start_time + session_duration;
+
+		uint64_t current_time = session_start_time;
+		while (current_time < session_end_time)
+		{
+			switch (random_generator() % 5)
+			{
+			case 0: // Typing, the presses of consecutive keys overlap and a release is dropped once in a while
+				for (uint64_t key_count = random_between(1, 40); key_count; key_count--)
+				{
+					uint16_t virtual_key = static_cast<uint16_t>(0x41 + random_generator() % 26);
+					test_events.push_back({ current_time, ETestEvent::key_down, virtual_key });
+					if (random_generator() % 100)
+					{
+						test_events.push_back({ current_time + random_between(30, 250), ETestEvent::key_up, virtual_key });
+					}
+					current_time += random_between(40, 300);
+				}
+				break;
+
+			case 1: // Mouse movement with the odd wheel report
+				for (uint64_t movement_end_time = current_time + random_between(100, 8000); current_time < movement_end_time; current_time += random_between(1, 16))
+				{
+					test_events.push_back({ current_time, random_generator() % 20 ? ETestEvent::mouse_movement : ETestEvent::mouse_wheel, 0 });
+				}
+				break;
+
+			case 2: // Drag
+				{
+					uint16_t mouse_button = test_mouse_buttons[random_generator() % 3];
+					test_events.push_back({ current_time, ETestEvent::button_down, mouse_button });
+					for (uint64_t drag_end_time = current_time + random_between(200, 3000); current_time < drag_end_time; current_time += random_between(1, 16))
+					{
+						test_events.push_back({ current_time, ETestEvent::mouse_movement, 0 });
+					}
+					if (random_generator() % 100)
+					{
+						test_events.push_back({ current_time, ETestEvent::button_up, mouse_button });
+					}
+				}
+				break;
+
+			case 3: // Idle
+				current_time += random_between(500, 30000);
+				break;
+
+			case 4: // A pause around the pointer idle gap
+				current_time += random_between(50, 2 * INPUT_POINTER_IDLE_GAP);
+				break;
+			}
+		}
+
+		// The timers of the monitor and the app switches
+		for (uint64_t timer_time = session_start_time + INPUT_MONITOR_RESET_THRESHOLD; timer_time < session_end_time; timer_time += INPUT_MONITOR_RESET_THRESHOLD)
+		{
+			test_events.push_back({ timer_time, ETestEvent::timer, 0 });
+		}
+		for (uint64_t checkpoint_time = session_start_time + INPUT_MONITOR_CHECKPOINT_INTERVAL; checkpoint_time < session_end_time; checkpoint_time += INPUT_MONITOR_CHECKPOINT_INTERVAL)
+		{
+			test_events.push_back({ checkpoint_time, ETestEvent::checkpoint, 0 });
+		}
+		for (uint64_t switch_time = session_start_time + random_between(5000, 120000); switch_time < session_end_time; switch_time += random_between(5000, 120000))
+		{
+			test_events.push_back({ switch_time, ETestEvent::app_switch, 0 });
+		}
+
+		std::stable_sort(test_events.begin(), test_events.end(), [](const STestEvent &left, const STestEvent &right) { return left.event_time < right.event_time; });
+
+		return test_events;
+	}
+
+	void save_checkpoint(const CInputAccounting &input_accounting, const STestLog &test_log, uint64_t current_time, SCheckpointState &checkpoint_state)
+	{
+		checkpoint_state.log_segment = 1;
+		checkpoint_state.log_position = test_log.record_count;
+		input_accounting.save_checkpoint(checkpoint_state, current_time);
+	}
+
+	void apply_input_event(CInputAccounting &input_accounting, const STestEvent &test_event)
+	{
+		switch (test_event.test_event)
+		{
+		case ETestEvent::key_down:
+			input_accounting.on_key_down(test_event.input_code, test_event.event_time);
+			break;
+
+		case ETestEvent::key_up:
+			input_accounting.on_key_up(test_event.input_code, test_event.event_time);
+			break;
+
+		case ETestEvent::button_down:
+			input_accounting.on_mouse_activated(test_event.input_code, test_event.event_time);
+			break;
+
+		case ETestEvent::button_up:
+			input_accounting.on_mouse_deactivated(test_event.input_code, test_event.event_time);
+			break;
+
+		case ETestEvent::mouse_wheel:
+			input_accounting.on_mouse_wheel_scroll(test_event.event_time);
+			break;
+
+		case ETestEvent::mouse_movement:
+			input_accounting.on_mouse_movement(test_event.event_time);
+			break;
+
+		default:
+			break;
+		}
+	}
+
+	void apply_event(CInputAccounting &input_accounting, const STestEvent &test_event, STestLog &test_log, SCheckpointState &checkpoint_state)
+	{
+		switch (test_event.test_event)
+		{
+		case ETestEvent::app_switch:
+		case ETestEvent::timer:
+			test_log.total_duration += input_accounting.collect_input_duration(test_event.event_time);
+			test_log.record_count++;
+			break;
+
+		case ETestEvent::checkpoint:
+			save_checkpoint(input_accounting, test_log, test_event.event_time, checkpoint_state);
+			break;
+
+		default:
+			apply_input_event(input_accounting, test_event);
+			break;
+		}
+	}
+
+	uint64_t get_session_finish_time()
+	{
+		return session_start_time + session_duration + INPUT_MONITOR_RESET_THRESHOLD + INPUT_POINTER_IDLE_GAP;
+	}
+
+	uint64_t finish_session(CInputAccounting &input_accounting, STestLog &test_log)
+	{
+		test_log.total_duration += input_accounting.collect_input_duration(get_session_finish_time());
+		test_log.record_count++;
+
+		return test_log.total_duration;
+	}
+
+	SReferenceRun run_reference(const std::vector<STestEvent> &test_events)
+	{
+		SReferenceRun reference_run = {};
+		reference_run.accounted_times.resize(test_events.size());
+		reference_run.logged_times.resize(test_events.size());
+		reference_run.idle_events.resize(test_events.size());
+
+		CInputAccounting reference_accounting;
+		reference_accounting.reset(session_start_time);
+		STestLog reference_log = {};
+		SCheckpointState reference_checkpoint = {};
+		for (size_t event_index = 0; event_index < test_events.size(); event_index++)
+		{
+			apply_event(reference_accounting, test_events[event_index], reference_log, reference_checkpoint);
+
+			SCheckpointState accounted_state = {};
+			reference_accounting.save_checkpoint(accounted_state, test_events[event_index].event_time);
+			reference_run.accounted_times[event_index] = reference_log.total_duration + accounted_state.pending_duration;
+			reference_run.logged_times[event_index] = reference_log.total_duration;
+			reference_run.idle_events[event_index] = reference_accounting.is_keyboard_activity_inactive() && reference_accounting.is_mouse_activity_inactive();
+		}
+		reference_run.duration = finish_session(reference_accounting, reference_log);
+
+		return reference_run;
+	}
+
+	// What the uninterrupted run accounted for from where a restarted monitor picks up until it went idle after the restart, which is when
+	// both runs agree again
+	uint64_t get_loss_bound(const std::vector<STestEvent> &test_events, const SReferenceRun &reference_run, uint64_t known_time, size_t restart_index)
+	{
+		size_t converged_index = restart_index;
+		while (converged_index < test_events.size() && !reference_run.idle_events[converged_index])
+		{
+			converged_index++;
+		}
+		uint64_t converged_accounted_time = converged_index < test_events.size() ? reference_run.accounted_times[converged_index] : reference_run.duration;
+
+		return converged_accounted_time - std::min(known_time, converged_accounted_time);
+	}
+
+	size_t find_restart_index(const std::vector<STestEvent> &test_events, size_t event_index, uint64_t restart_time)
+	{
+		while (event_index < test_events.size() && test_events[event_index].event_time < restart_time)
+		{
+			event_index++;
+		}
+
+		return event_index;
+	}
+
+	void test_open_span_survives_shutdown()
+	{
+		// A key held across the shutdown, whose release the restart never sees
+		{
+			CInputAccounting input_accounting;
+			input_accounting.reset(1000);
+			input_accounting.on_key_down(0x41, 2000);
+			input_accounting.on_key_down(0x41, 4500); // Autorepeat
+
+			STestLog test_log = {};
+			SCheckpointState checkpoint_state = {};
+			save_checkpoint(input_accounting, test_log, 5000, checkpoint_state);
+
+			CInputAccounting restarted_accounting;
+			restarted_accounting.reset(6000);
+			restarted_accounting.restore_checkpoint(checkpoint_state, 1, test_log.record_count);
+			check(restarted_accounting.collect_input_duration(6000) == 2500, "the held key is restored up to its last input");
+
+			// Once the log has been written after the checkpoint, the record already holds the span
+			CInputAccounting stale_accounting;
+			stale_accounting.reset(6000);
+			stale_accounting.restore_checkpoint(checkpoint_state, 1, test_log.record_count + 1);
+			check(stale_accounting.collect_input_duration(6000) == 0, "a checkpoint older than the log is discarded");
+		}
+
+		// Mouse movement across the shutdown only lasts until its last report
+		{
+			CInputAccounting input_accounting;
+			input_accounting.reset(1000);
+			for (uint64_t report_time = 2000; report_time <= 3000; report_time += 10)
+			{
+				input_accounting.on_mouse_movement(report_time);
+			}
+
+			STestLog test_log = {};
+			SCheckpointState checkpoint_state = {};
+			save_checkpoint(input_accounting, test_log, 3500, checkpoint_state);
+			check(checkpoint_state.pending_duration == 1000, "the movement is checkpointed up to its last report");
+		}
+	}
+
+	void test_kills(uint32_t session_seed)
+	{
+		std::vector<STestEvent> test_events = generate_session(session_seed);
+		const size_t event_count = test_events.size();
+
+		const SReferenceRun reference_run = run_reference(test_events);
+		const uint64_t reference_duration = reference_run.duration;
+
+		std::mt19937 random_generator(session_seed * 7919);
+		uint64_t total_lost_time = 0, total_loss_bound = 0;
+		for (uint32_t trial_index = 0; trial_index < kill_trial_count; trial_index++)
+		{
+			std::vector<size_t> kill_indices;
+			for (uint32_t kill_count = 1 + random_generator() % max_kill_count; kill_count; kill_count--)
+			{
+				kill_indices.push_back(1 + random_generator() % (event_count - 1));
+			}
+			std::sort(kill_indices.begin(), kill_indices.end());
+
+			CInputAccounting input_accounting;
+			input_accounting.reset(session_start_time);
+			STestLog test_log = {};
+			SCheckpointState checkpoint_state = {};
+			size_t checkpoint_index = SIZE_MAX; // Event after which the checkpoint on disk was saved
+
+			uint64_t loss_bound = 0, invariant_violation_count = 0;
+			size_t kill_position = 0;
+			for (size_t event_index = 0; event_index < event_count;)
+			{
+				if (kill_position < kill_indices.size() && kill_indices[kill_position] == event_index)
+				{
+					uint64_t kill_time = test_events[event_index - 1].event_time;
+
+					// A clean shutdown saves a final checkpoint, a crash doesn't
+					if (random_generator() % 2)
+					{
+						save_checkpoint(input_accounting, test_log, kill_time, checkpoint_state);
+						checkpoint_index = event_index - 1;
+					}
+
+					uint64_t restart_time = kill_time + random_generator() % (max_downtime + 1);
+					size_t restart_index = find_restart_index(test_events, event_index, restart_time);
+					while (kill_position < kill_indices.size() && kill_indices[kill_position] <= restart_index)
+					{
+						kill_position++;
+					}
+
+					uint64_t checkpoint_accounted_time = checkpoint_index == SIZE_MAX ? 0 : reference_run.accounted_times[checkpoint_index];
+					loss_bound += get_loss_bound(test_events, reference_run, checkpoint_accounted_time, restart_index);
+
+					input_accounting.reset(restart_time);
+					input_accounting.restore_checkpoint(checkpoint_state, 1, test_log.record_count);
+
+					event_index = restart_index;
+					continue;
+				}
+
+				apply_event(input_accounting, test_events[event_index], test_log, checkpoint_state);
+				if (test_events[event_index].test_event == ETestEvent::checkpoint)
+				{
+					checkpoint_index = event_index;
+				}
+
+				if (!input_accounting.check_invariants(test_events[event_index].event_time))
+				{
+					invariant_violation_count++;
+				}
+
+				event_index++;
+			}
+			uint64_t duration = finish_session(input_accounting, test_log);
+
+			std::string trial_name = "session " + std::to_string(session_seed) + " trial " + std::to_string(trial_index);
+			check(duration <= reference_duration, trial_name + ": no time is counted twice (" + std::to_string(duration) + " > " + std::to_string(reference_duration) + ")");
+			check(reference_duration - std::min(duration, reference_duration) <= loss_bound, trial_name + ": only the time a restart can't know about is lost (" +
+				std::to_string(reference_duration - std::min(duration, reference_duration)) + " > " + std::to_string(loss_bound) + ")");
+			check(invariant_violation_count == 0, trial_name + ": the accounting invariants hold");
+
+			total_lost_time += reference_duration - std::min(duration, reference_duration);
+			total_loss_bound += loss_bound;
+		}
+
+		std::cout << "session " << session_seed << ": " << event_count << " events, " << reference_duration << " ms of input, " << kill_trial_count <<
+			" trials lost " << total_lost_time << " ms in total against a bound of " << total_loss_bound << " ms" << std::endl;
+	}
+
+	std::wstring create_test_directory()
+	{
+		char directory_template[] = "/tmp/checkpoint_replay_test_XXXXXX";
+		if (!::mkdtemp(directory_template))
+		{
+			return std::wstring();
+		}
+
+		std::string directory = directory_template;
+		return std::wstring(directory.begin(), directory.end()) + L"/";
+	}
+
+	void remove_test_directory(const std::wstring &directory)
+	{
+		for (const auto &file_name : CFileSystem::find_files(directory + L"*"))
+		{
+			CFileSystem::delete_file(file_name);
+		}
+
+		::rmdir(CFileSystem::get_stream_name(directory).data());
+	}
+
+	// Sums the durations of the records on disk and finds the last of them
+	void read_log(const std::wstring &file_prefix, uint64_t &logged_duration, uint64_t &last_record_time)
+	{
+		logged_duration = 0;
+		last_record_time = 0;
+		for (uint32_t segment_number : CFileWriter::find_segment_numbers(file_prefix))
+		{
+			std::vector<byte> segment_data;
+			CFileSystem::read_file(CFileWriter::get_segment_file_name(file_prefix, segment_number), segment_data);
+
+			std::vector<SAppUsageRecord> app_usage_records;
+			CLogCompactor::parse_records(std::wstring(segment_data.begin(), segment_data.end()), app_usage_records);
+			for (const auto &app_usage_record : app_usage_records)
+			{
+				logged_duration += app_usage_record.duration;
+				last_record_time = app_usage_record.record_time;
+			}
+		}
+	}
+
+	// What the uninterrupted run had logged by the record written at the given time, taking the first or the last record of that time
+	uint64_t get_reference_logged_time(const std::vector<STestEvent> &test_events, const SReferenceRun &reference_run, uint64_t record_time,
+		size_t event_count, bool is_last_record)
+	{
+		if (record_time == get_session_finish_time())
+		{
+			return reference_run.duration;
+		}
+
+		uint64_t logged_time = 0;
+		for (size_t event_index = 0; event_index < event_count; event_index++)
+		{
+			const STestEvent &test_event = test_events[event_index];
+			if ((test_event.test_event == ETestEvent::timer || test_event.test_event == ETestEvent::app_switch) && test_event.event_time == record_time)
+			{
+				logged_time = reference_run.logged_times[event_index];
+				if (!is_last_record)
+				{
+					break;
+				}
+			}
+		}
+
+		return logged_time;
+	}
+
+	// A monitor restarting from the files on disk the way CRawInput::init does, then replaying the session from the given event on
+	int run_monitor(const std::wstring &file_prefix, const std::vector<STestEvent> &test_events, size_t start_index, uint64_t restart_time,
+		SMonitorProgress &monitor_progress)
+	{
+		CLogIndex log_index;
+		log_index.init((file_prefix + L".index").data());
+		log_index.load();
+
+		CFileWriter file_writer;
+		if (!file_writer.init(file_prefix.data(), &log_index, CLogCompactor::find_compacted_through_segment(file_prefix), test_segment_size, UINT64_MAX))
+		{
+			return 1;
+		}
+
+		CCheckpoint checkpoint;
+		checkpoint.init((file_prefix + L".checkpoint").data());
+
+		CInputAccounting input_accounting;
+		input_accounting.reset(restart_time);
+
+		std::wstring app_path;
+		SCheckpointState checkpoint_state;
+		if (checkpoint.load(checkpoint_state))
+		{
+			app_path = checkpoint_state.app_path;
+			input_accounting.restore_checkpoint(checkpoint_state, file_writer.get_segment_number(), file_writer.get_segment_size());
+		}
+
+		auto write_record = [&](uint64_t record_time, size_t event_count)
+		{
+			uint64_t total_duration = input_accounting.collect_input_duration(record_time);
+			std::wstring json_buffer = L"{\n\n\t \"app_name\" : \"" + app_path + L"\",\n\t \"duration\" : " + std::to_wstring(total_duration) +
+				L",\n\t \"time\" : " + std::to_wstring(record_time) + L"\n}\n";
+			file_writer.write_data(json_buffer.data(), record_time);
+			monitor_progress.logged_event_count = event_count;
+		};
+
+		for (size_t event_index = start_index; event_index < test_events.size(); event_index++)
+		{
+			const STestEvent &test_event = test_events[event_index];
+			switch (test_event.test_event)
+			{
+			case ETestEvent::app_switch:
+			case ETestEvent::timer:
+				write_record(test_event.event_time, event_index + 1);
+				if (test_event.test_event == ETestEvent::app_switch)
+				{
+					app_path = L"C:\\Program Files\\app " + std::to_wstring(event_index) + L"\\app.exe";
+				}
+				break;
+
+			case ETestEvent::checkpoint:
+				checkpoint_state.log_segment = file_writer.get_segment_number();
+				checkpoint_state.log_position = file_writer.get_segment_size();
+				input_accounting.save_checkpoint(checkpoint_state, test_event.event_time);
+				checkpoint_state.app_path = app_path;
+				if (checkpoint.save(checkpoint_state))
+				{
+					monitor_progress.checkpoint_event_count = event_index + 1;
+				}
+				break;
+
+			default:
+				apply_input_event(input_accounting, test_event);
+				break;
+			}
+
+			monitor_progress.event_count = event_index + 1;
+		}
+
+		write_record(get_session_finish_time(), test_events.size());
+		monitor_progress.is_finished = true;
+
+		return 0;
+	}
+
+	void test_process_kills(uint32_t session_seed)
+	{
+		std::vector<STestEvent> test_events = generate_session(session_seed);
+		const size_t event_count = test_events.size();
+		const SReferenceRun reference_run = run_reference(test_events);
+
+		std::wstring directory = create_test_directory();
+		SMonitorProgress *monitor_progress = static_cast<SMonitorProgress *>(::mmap(nullptr, sizeof(SMonitorProgress), PROT_READ | PROT_WRITE,
+			MAP_SHARED | MAP_ANONYMOUS, -1, 0));
+		if (directory.empty() || monitor_progress == MAP_FAILED)
+		{
+			check(false, "the test directory and the progress can be created");
+			return;
+		}
+		new (monitor_progress) SMonitorProgress();
+
+		const std::wstring file_prefix = directory + L"app_input_data";
+		const std::string session_name = "session " + std::to_string(session_seed) + " with processes";
+
+		std::mt19937 random_generator(session_seed * 104729);
+		size_t start_index = 0;
+		uint64_t restart_time = session_start_time, loss_bound = 0;
+		uint64_t run_logged_duration = 0, run_reference_time = 0;
+		uint32_t kill_count = 0, torn_checkpoint_count = 0;
+		while (true)
+		{
+			monitor_progress->event_count = start_index;
+			monitor_progress->is_finished = false;
+
+			pid_t process_id = ::fork();
+			if (process_id == 0)
+			{
+				::_exit(run_monitor(file_prefix, test_events, start_index, restart_time, *monitor_progress));
+			}
+
+			// Kill the monitor once it gets past a random event, spreading the kills over the session
+			size_t kill_index = SIZE_MAX;
+			if (kill_count < process_kill_count && start_index < event_count)
+			{
+				kill_index = start_index + random_generator() % std::min(event_count - start_index, event_count / process_kill_count);
+			}
+			auto start_time = std::chrono::steady_clock::now();
+			int process_status = 0;
+			while (::waitpid(process_id, &process_status, WNOHANG) == 0)
+			{
+				if (monitor_progress->event_count >= kill_index || std::chrono::steady_clock::now() - start_time > monitor_timeout)
+				{
+					::kill(process_id, SIGKILL);
+					::waitpid(process_id, &process_status, 0);
+					break;
+				}
+				std::this_thread::yield();
+			}
+
+			// The kill may have landed in the middle of the event after the last one completed
+			size_t killed_event_count = std::min(static_cast<size_t>(monitor_progress->event_count.load()) + 1, event_count);
+
+			// Whatever a restarted monitor picked up, it can't have logged more than the uninterrupted run did over the same records
+			uint64_t logged_duration = 0, last_record_time = 0;
+			read_log(file_prefix, logged_duration, last_record_time);
+			if (logged_duration != run_logged_duration)
+			{
+				uint64_t reference_logged_time = get_reference_logged_time(test_events, reference_run, last_record_time, killed_event_count, true);
+				check(logged_duration - run_logged_duration <= reference_logged_time - std::min(run_reference_time, reference_logged_time),
+					session_name + ": no time is counted twice after restart " + std::to_string(kill_count) + " (" +
+					std::to_string(logged_duration - run_logged_duration) + " > " + std::to_string(reference_logged_time) + " - " + std::to_string(run_reference_time) + ")");
+				run_logged_duration = logged_duration;
+				run_reference_time = get_reference_logged_time(test_events, reference_run, last_record_time, killed_event_count, false);
+			}
+
+			if (monitor_progress->is_finished)
+			{
+				break;
+			}
+			if (!WIFSIGNALED(process_status) || std::chrono::steady_clock::now() - start_time > monitor_timeout)
+			{
+				check(false, session_name + ": the monitor ran until it was killed");
+				break;
+			}
+			kill_count++;
+
+			// The restart comes after anything the killed monitor may have done, the event it was in the middle of included
+			uint64_t kill_time = killed_event_count ? test_events[killed_event_count - 1].event_time : restart_time;
+
+			// What the restart can know about: the log up to its last record and, unless it's torn, the checkpoint
+			uint64_t logged_event_count = monitor_progress->logged_event_count, checkpoint_event_count = monitor_progress->checkpoint_event_count;
+			uint64_t known_time = logged_event_count ? reference_run.logged_times[logged_event_count - 1] : 0;
+			uint64_t checkpoint_size = 0;
+			if (random_generator() % 100 < torn_checkpoint_percent && CFileSystem::get_file_size(file_prefix + L".checkpoint", checkpoint_size) && checkpoint_size)
+			{
+				::truncate(CFileSystem::get_stream_name(file_prefix + L".checkpoint").data(), static_cast<off_t>(random_generator() % checkpoint_size));
+				monitor_progress->checkpoint_event_count = 0;
+				torn_checkpoint_count++;
+			}
+			else if (checkpoint_event_count)
+			{
+				known_time = std::max(known_time, reference_run.accounted_times[checkpoint_event_count - 1]);
+			}
+
+			restart_time = kill_time + random_generator() % (max_downtime + 1);
+			start_index = find_restart_index(test_events, killed_event_count, restart_time);
+			loss_bound += get_loss_bound(test_events, reference_run, known_time, start_index);
+		}
+
+		uint64_t duration = run_logged_duration;
+		uint64_t lost_time = reference_run.duration - std::min(duration, reference_run.duration);
+		check(duration <= reference_run.duration, session_name + ": no time is counted twice (" + std::to_string(duration) + " > " +
+			std::to_string(reference_run.duration) + ")");
+		check(lost_time <= loss_bound, session_name + ": only the time a restart can't know about is lost (" + std::to_string(lost_time) + " > " +
+			std::to_string(loss_bound) + ")");
+
+		std::cout << session_name << ": " << kill_count << " kills, " << torn_checkpoint_count << " torn checkpoints, lost " << lost_time << " of " <<
+			reference_run.duration << " ms against a bound of " << loss_bound << " ms" << std::endl;
+
+		::munmap(monitor_progress, sizeof(SMonitorProgress));
+		remove_test_directory(directory);
+	}
+
+	void test_checkpoint_file()
+	{
+		std::wstring directory = create_test_directory();
+		if (directory.empty())
+		{
+			check(false, "the test directory can be created");
+			return;
+		}
+
+		CCheckpoint checkpoint;
+		checkpoint.init((directory + L"app_input_data.checkpoint").data());
+
+		SCheckpointState checkpoint_state = {};
+		check(!checkpoint.load(checkpoint_state), "there's no checkpoint before the first save");
+
+		SCheckpointState saved_state = {};
+		saved_state.log_segment = 7;
+		saved_state.log_position = 0x123456789ull;
+		saved_state.pending_duration = 4321;
+		saved_state.app_path = L"C:\\Program Files\\app\\app.exe";
+		check(checkpoint.save(saved_state), "the checkpoint saves");
+		check(checkpoint.load(checkpoint_state) && checkpoint_state.log_segment == saved_state.log_segment && checkpoint_state.log_position == saved_state.log_position &&
+			checkpoint_state.pending_duration == saved_state.pending_duration && checkpoint_state.app_path == saved_state.app_path, "the checkpoint loads as it was saved");
+
+		// An unchanged state isn't written again, a changed one is
+		CFileSystem::delete_file(directory + L"app_input_data.checkpoint");
+		uint64_t checkpoint_size = 0;
+		check(checkpoint.save(saved_state) && !CFileSystem::get_file_size(directory + L"app_input_data.checkpoint", checkpoint_size),
+			"an unchanged checkpoint isn't saved again");
+		saved_state.pending_duration++;
+		check(checkpoint.save(saved_state) && CFileSystem::get_file_size(directory + L"app_input_data.checkpoint", checkpoint_size),
+			"a changed checkpoint is saved");
+
+		std::vector<byte> checkpoint_data;
+		CFileSystem::read_file(directory + L"app_input_data.checkpoint", checkpoint_data);
+
+		// Every torn or corrupted file is rejected
+		uint32_t accepted_count = 0;
+		for (size_t checkpoint_size = 0; checkpoint_size < checkpoint_data.size(); checkpoint_size++)
+		{
+			CFileSystem::write_file(directory + L"app_input_data.checkpoint", std::vector<byte>(checkpoint_data.begin(), checkpoint_data.begin() + checkpoint_size));
+			accepted_count += checkpoint.load(checkpoint_state);
+		}
+		check(accepted_count == 0, "a truncated checkpoint is rejected (" + std::to_string(accepted_count) + " accepted)");
+
+		accepted_count = 0;
+		for (size_t byte_index = 0; byte_index < checkpoint_data.size(); byte_index++)
+		{
+			std::vector<byte> corrupted_data = checkpoint_data;
+			corrupted_data[byte_index] ^= 0x10;
+			CFileSystem::write_file(directory + L"app_input_data.checkpoint", corrupted_data);
+			accepted_count += checkpoint.load(checkpoint_state);
+		}
+		check(accepted_count == 0, "a corrupted checkpoint is rejected (" + std::to_string(accepted_count) + " accepted)");
+
+		// A save that died before replacing the checkpoint leaves the previous one in place
+		CFileSystem::write_file(directory + L"app_input_data.checkpoint", checkpoint_data);
+		CFileSystem::write_file(directory + L"app_input_data.checkpoint.tmp", std::vector<byte>(checkpoint_data.begin(), checkpoint_data.begin() + 10));
+		check(checkpoint.load(checkpoint_state) && checkpoint_state.pending_duration == saved_state.pending_duration, "a torn temporary file doesn't replace the checkpoint");
+
+		// The pending duration only counts when the log still ends where the checkpoint was saved
+		{
+			std::wstring file_prefix = directory + L"app_input_data";
+
+			CLogIndex log_index;
+			log_index.init((file_prefix + L".index").data());
+			CFileWriter file_writer;
+			file_writer.init(file_prefix.data(), &log_index, 0, test_segment_size, UINT64_MAX);
+			file_writer.write_data(L"{\n\n\t \"app_name\" : \"app.exe\",\n\t \"duration\" : 5,\n\t \"time\" : 1\n}\n", 1);
+
+			saved_state.log_segment = file_writer.get_segment_number();
+			saved_state.log_position = file_writer.get_segment_size();
+			checkpoint.save(saved_state);
+			file_writer.close();
+
+			// Restarted as it was saved
+			CLogIndex restarted_log_index;
+			restarted_log_index.init((file_prefix + L".index").data());
+			restarted_log_index.load();
+			CFileWriter restarted_file_writer;
+			restarted_file_writer.init(file_prefix.data(), &restarted_log_index, 0, test_segment_size, UINT64_MAX);
+
+			CInputAccounting input_accounting;
+			input_accounting.reset(1000);
+			checkpoint.load(checkpoint_state);
+			input_accounting.restore_checkpoint(checkpoint_state, restarted_file_writer.get_segment_number(), restarted_file_writer.get_segment_size());
+			check(input_accounting.collect_input_duration(1000) == saved_state.pending_duration, "the checkpoint matching the log on disk is restored");
+
+			// A record written after the checkpoint already holds its duration
+			restarted_file_writer.write_data(L"{\n\n\t \"app_name\" : \"app.exe\",\n\t \"duration\" : 6,\n\t \"time\" : 2\n}\n", 2);
+			CInputAccounting stale_accounting;
+			stale_accounting.reset(1000);
+			stale_accounting.restore_checkpoint(checkpoint_state, restarted_file_writer.get_segment_number(), restarted_file_writer.get_segment_size());
+			check(stale_accounting.collect_input_duration(1000) == 0, "the checkpoint older than the log on disk is discarded");
+		}
+
+		remove_test_directory(directory);
+	}
+
+}
+
+int main()
+{
+	test_open_span_survives_shutdown();
+
+	for (uint32_t session_seed = 1; session_seed <= session_count; session_seed++)
+	{
+		test_kills(session_seed);
+	}
+
+	test_checkpoint_file();
+
+	for (uint32_t session_seed = 1; session_seed <= process_session_count; session_seed++)
+	{
+		test_process_kills(session_seed);
+	}
+
+	std::cout << (g_failure_count ? "FAILED" : "PASSED") << std::endl;
+
+	return g_failure_count ? 1 : 0;
+}
\ No newline at end of file
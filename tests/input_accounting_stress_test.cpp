@@ -0,0 +1,236 @@
+//
+//
+
+#include "stdafx.h"
+
+#include "checkpoint.h"
+#include "adaptive_sampling.h"
+#include "input_accounting.h"
+#include "stress_generator.h"
+
+// Drives the accounting core from several producer threads with randomized, interleaved key, button, wheel, movement, app switch and
+// timer events, serialized by a mutex the way CRawInput serializes them, dropping and duplicating some of the events the way a secure
+// desktop or a lost report would. The accounting invariants are checked while the producers run, the time collected may never go
+// negative nor exceed the time that passed, and once the input stops everything still held has to drain on the timer. CStressGenerator
+// runs the same load through CRawInput with /stress on Windows.
+
+namespace
+{
+	constexpr uint64_t stress_duration = 2000; // Milliseconds of real time
+	constexpr uint64_t stress_start_time = 1000; // Simulated milliseconds, a span never starts at zero
+	constexpr uint32_t stress_fault_percents[] = { STRESS_DROP_PERCENT, 10 }; // Both drops and duplicates, the second one far worse than real input
+
+	constexpr uint16_t stress_virtual_keys[] = { 0x10, 0x11, 0x12, 0x41, 0x42, 0x43, 0x44, 0x45 };
+	constexpr uint16_t stress_mouse_buttons[] = { 0x0001, 0x0010, 0x0004 }; // RI_MOUSE_LEFT_BUTTON_DOWN, MIDDLE and RIGHT
+
+	uint32_t g_failure_count = 0;
+
+	void check(bool condition, const std::string &description)
+	{
+		if (!condition)
+		{
+			std::cout << "FAILED: " << description << std::endl;
+			g_failure_count++;
+		}
+	}
+
+	enum class EStressEvent
+	{
+		key_down,
+		key_up,
+		button_down,
+		button_up,
+		mouse_wheel,
+		mouse_movement,
+		app_switch,
+		timer,
+	};
+
+	// Same mix as CStressGenerator, app switches and timer ticks are rare compared to raw input
+	EStressEvent pick_stress_event(uint32_t random_number)
+	{
+		uint32_t event_weight = random_number % 10000;
+		if (event_weight < 1500) return EStressEvent::key_down;
+		if (event_weight < 3000) return EStressEvent::key_up;
+		if (event_weight < 4000) return EStressEvent::button_down;
+		if (event_weight < 5000) return EStressEvent::button_up;
+		if (event_weight < 6000) return EStressEvent::mouse_wheel;
+		if (event_weight < 9990) return EStressEvent::mouse_movement;
+		if (event_weight < 9995) return EStressEvent::app_switch;
+		return EStressEvent::timer;
+	}
+
+	// The accounting with the lock and the clock CRawInput wraps it in, and what the log would have received
+	struct SStressTarget
+	{
+		std::mutex accounting_mutex;
+		CInputAccounting input_accounting;
+		std::atomic<uint64_t> simulated_time; // Every event advances it by a millisecond
+
+		uint64_t collected_time; // Written to the log by the app switches and the timer
+		uint64_t last_collect_time;
+		uint64_t negative_collect_count; // Collections of time that can't have passed, which is time gone negative
+		uint64_t overcount_collect_count; // Collections that take the time written past the wall time
+	};
+
+	void collect_input_duration(SStressTarget &stress_target, uint64_t current_time)
+	{
+		// A movement span ends at its last report, so a collection can take the part of it up to the idle gap before the previous collection
+		uint64_t input_duration = stress_target.input_accounting.collect_input_duration(current_time);
+		if (input_duration > current_time - stress_target.last_collect_time + INPUT_POINTER_IDLE_GAP)
+		{
+			stress_target.negative_collect_count++;
+		}
+		if (stress_target.collected_time + input_duration > current_time - stress_start_time)
+		{
+			stress_target.overcount_collect_count++;
+		}
+
+		stress_target.collected_time += input_duration;
+		stress_target.last_collect_time = current_time;
+	}
+
+	uint64_t producer_thread(SStressTarget &stress_target, const std::atomic<bool> &is_stopping, uint32_t seed, uint32_t fault_percent)
+	{
+		std::mt19937 random_generator(seed);
+
+		uint64_t event_count = 0;
+		while (!is_stopping.load(std::memory_order_relaxed))
+		{
+			uint32_t random_number = random_generator();
+			EStressEvent stress_event = pick_stress_event(random_number);
+
+			uint16_t virtual_key = stress_virtual_keys[(random_number >> 16) % (sizeof(stress_virtual_keys) / sizeof(stress_virtual_keys[0]))];
+			uint16_t mouse_button = stress_mouse_buttons[(random_number >> 16) % (sizeof(stress_mouse_buttons) / sizeof(stress_mouse_buttons[0]))];
+
+			uint32_t fault_number = random_generator() % 100;
+			bool is_dropped = fault_number < fault_percent && (stress_event == EStressEvent::key_up || stress_event == EStressEvent::button_up);
+			uint32_t delivery_count = is_dropped ? 0 : (fault_number >= 100 - fault_percent ? 2 : 1);
+
+			stress_target.simulated_time++;
+
+			for (uint32_t delivery_index = 0; delivery_index < delivery_count; delivery_index++)
+			{
+				std::lock_guard<std::mutex> accounting_mutex(stress_target.accounting_mutex);
+
+				uint64_t current_time = stress_target.simulated_time;
+				switch (stress_event)
+				{
+				case EStressEvent::key_down:
+					stress_target.input_accounting.on_key_down(virtual_key, current_time);
+					break;
+
+				case EStressEvent::key_up:
+					stress_target.input_accounting.on_key_up(virtual_key, current_time);
+					break;
+
+				case EStressEvent::button_down:
+					stress_target.input_accounting.on_mouse_activated(mouse_button, current_time);
+					break;
+
+				case EStressEvent::button_up:
+					stress_target.input_accounting.on_mouse_deactivated(mouse_button, current_time);
+					break;
+
+				case EStressEvent::mouse_wheel:
+					stress_target.input_accounting.on_mouse_wheel_scroll(current_time);
+					break;
+
+				case EStressEvent::mouse_movement:
+					stress_target.input_accounting.on_mouse_movement(current_time);
+					break;
+
+				case EStressEvent::app_switch:
+				case EStressEvent::timer:
+					collect_input_duration(stress_target, current_time);
+					break;
+				}
+
+				event_count++;
+			}
+		}
+
+		return event_count;
+	}
+
+	void test_stress(uint32_t fault_percent)
+	{
+		SStressTarget stress_target;
+		stress_target.simulated_time = stress_start_time;
+		stress_target.input_accounting.reset(stress_start_time);
+		stress_target.collected_time = 0;
+		stress_target.last_collect_time = stress_start_time;
+		stress_target.negative_collect_count = stress_target.overcount_collect_count = 0;
+
+		std::atomic<bool> is_stopping(false);
+		std::vector<uint64_t> event_counts(STRESS_PRODUCER_COUNT);
+		uint64_t invariant_check_count = 0, invariant_violation_count = 0;
+
+		auto start_time = std::chrono::steady_clock::now();
+
+		std::vector<std::thread> producer_threads;
+		for (uint32_t producer_index = 0; producer_index < STRESS_PRODUCER_COUNT; producer_index++)
+		{
+			producer_threads.emplace_back([&, producer_index]()
+				{ event_counts[producer_index] = producer_thread(stress_target, is_stopping, producer_index + 1, fault_percent); });
+		}
+
+		while (std::chrono::steady_clock::now() - start_time < std::chrono::milliseconds(stress_duration))
+		{
+			{
+				std::lock_guard<std::mutex> accounting_mutex(stress_target.accounting_mutex);
+
+				invariant_violation_count += stress_target.input_accounting.check_invariants(stress_target.simulated_time) ? 0 : 1;
+				invariant_check_count++;
+			}
+
+			std::this_thread::sleep_for(std::chrono::milliseconds(STRESS_INVARIANT_CHECK_INTERVAL));
+		}
+		is_stopping = true;
+
+		for (auto &producer_thread : producer_threads)
+		{
+			producer_thread.join();
+		}
+
+		auto elapsed_time = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start_time).count();
+
+		uint64_t event_count = 0;
+		for (uint64_t producer_event_count : event_counts)
+		{
+			event_count += producer_event_count;
+		}
+
+		// Nothing is released by hand: the keys and buttons whose release was dropped, and the duplicated button downs, have to be drained
+		// by the timer once the input has been idle for the reset threshold, as they would be in the monitor
+		uint64_t missed_input_event_count = stress_target.input_accounting.get_missed_input_event_count();
+		uint64_t finish_time = stress_target.simulated_time + INPUT_MONITOR_RESET_THRESHOLD;
+		collect_input_duration(stress_target, finish_time);
+
+		std::string stress_name = std::to_string(fault_percent) + "% dropped and duplicated events";
+		check(invariant_violation_count == 0 && stress_target.input_accounting.check_invariants(finish_time), stress_name + ": the invariants hold (" +
+			std::to_string(invariant_violation_count) + " of " + std::to_string(invariant_check_count) + " checks failed)");
+		check(stress_target.negative_collect_count == 0, stress_name + ": no time goes negative");
+		check(stress_target.overcount_collect_count == 0 && stress_target.collected_time == stress_target.input_accounting.get_total_accumulated_time(),
+			stress_name + ": the time written never exceeds the wall time");
+		check(stress_target.input_accounting.is_keyboard_activity_inactive() && stress_target.input_accounting.is_mouse_activity_inactive(),
+			stress_name + ": the held input drains");
+
+		std::cout << stress_name << ": " << event_count << " events from " << STRESS_PRODUCER_COUNT << " threads in " << elapsed_time << " ms (" <<
+			(elapsed_time ? event_count * 1000 / elapsed_time : 0) << " events/s), " << invariant_check_count << " invariant checks, " <<
+			stress_target.collected_time << " of " << finish_time - stress_start_time << " ms accumulated, " << missed_input_event_count << " missed events, " <<
+			stress_target.input_accounting.get_missed_input_event_count() - missed_input_event_count << " held inputs drained" << std::endl;
+	}
+}
+
+int main()
+{
+	for (uint32_t fault_percent : stress_fault_percents)
+	{
+		test_stress(fault_percent);
+	}
+
+	std::cout << (g_failure_count ? "FAILED" : "PASSED") << std::endl;
+
+	return g_failure_count ? 1 : 0;
+}
\ No newline at end of file
@@ -0,0 +1,189 @@
+//
+//
+
+#include "stdafx.h"
+
+#include "shared_memory.h"
+#include "live_stats.h"
+
+#include <sys/wait.h>
+
+// A writer process publishes a stream of snapshots while reader processes read them concurrently through their own mappings. Every field
+// of a snapshot is derived from its publish number, so a torn read that mixes two snapshots is detected, and the publish numbers a reader
+// sees must never go back.
+
+namespace
+{
+	constexpr uint64_t publish_count = 20000;
+	constexpr uint32_t reader_count = 3;
+	constexpr auto reader_timeout = std::chrono::seconds(60);
+
+	void fill_path(wchar_t *path, uint64_t publish_number, uint32_t path_index)
+	{
+		uint32_t path_length = static_cast<uint32_t>((publish_number + path_index) % (MAX_PATH - 1));
+		std::fill(path, path + path_length, static_cast<wchar_t>(L'a' + (publish_number + path_index) % 26));
+		path[path_length] = 0;
+	}
+
+	bool is_path_filled(const wchar_t *path, uint64_t publish_number, uint32_t path_index)
+	{
+		wchar_t expected_path[MAX_PATH] = { 0 };
+		fill_path(expected_path, publish_number, path_index);
+
+		return wcscmp(path, expected_path) == 0;
+	}
+
+	void fill_snapshot(SLiveStatsSnapshot &live_stats_snapshot, uint64_t publish_number)
+	{
+		live_stats_snapshot.version = LIVE_STATS_VERSION;
+		live_stats_snapshot.app_count = static_cast<uint32_t>(publish_number % LIVE_STATS_MAX_APPS + 1);
+		live_stats_snapshot.update_time = publish_number * 1000;
+		fill_path(live_stats_snapshot.current_app_path, publish_number, 0);
+		live_stats_snapshot.key_events_per_second = publish_number * 2;
+		live_stats_snapshot.mouse_events_per_second = publish_number * 3;
+		live_stats_snapshot.key_event_count = publish_number * 5;
+		live_stats_snapshot.mouse_event_count = publish_number * 7;
+		live_stats_snapshot.missed_input_event_count = publish_number % 11;
+		live_stats_snapshot.written_record_count = publish_number;
+		live_stats_snapshot.checkpoint_failure_count = publish_number ^ 0x5a5a;
+		live_stats_snapshot.log_segment_number = publish_number / 100;
+
+		for (uint32_t app_index = 0; app_index < live_stats_snapshot.app_count; app_index++)
+		{
+			fill_path(live_stats_snapshot.apps[app_index].app_path, publish_number, app_index + 1);
+			live_stats_snapshot.apps[app_index].duration_today = publish_number + app_index;
+		}
+	}
+
+	bool is_snapshot_consistent(const SLiveStatsSnapshot &live_stats_snapshot)
+	{
+		uint64_t publish_number = live_stats_snapshot.written_record_count;
+		if (live_stats_snapshot.app_count != publish_number % LIVE_STATS_MAX_APPS + 1 || live_stats_snapshot.update_time != publish_number * 1000 ||
+			!is_path_filled(live_stats_snapshot.current_app_path, publish_number, 0) || live_stats_snapshot.key_events_per_second != publish_number * 2 ||
+			live_stats_snapshot.mouse_events_per_second != publish_number * 3 || live_stats_snapshot.key_event_count != publish_number * 5 ||
+			live_stats_snapshot.mouse_event_count != publish_number * 7 || live_stats_snapshot.missed_input_event_count != publish_number % 11 ||
+			live_stats_snapshot.checkpoint_failure_count != (publish_number ^ 0x5a5a) || live_stats_snapshot.log_segment_number != publish_number / 100)
+		{
+			return false;
+		}
+
+		for (uint32_t app_index = 0; app_index < live_stats_snapshot.app_count; app_index++)
+		{
+			if (!is_path_filled(live_stats_snapshot.apps[app_index].app_path, publish_number, app_index + 1) ||
+				live_stats_snapshot.apps[app_index].duration_today != publish_number + app_index)
+			{
+				return false;
+			}
+		}
+
+		return true;
+	}
+
+	int run_writer(const std::wstring &mapping_name)
+	{
+		CLiveStatsPublisher live_stats_publisher;
+		if (!live_stats_publisher.init(mapping_name.data()))
+		{
+			std::cout << "FAILED: the writer can't create the live stats" << std::endl;
+			return 1;
+		}
+
+		std::unique_ptr<SLiveStatsSnapshot> live_stats_snapshot(new SLiveStatsSnapshot());
+		for (uint64_t publish_number = 1; publish_number <= publish_count; publish_number++)
+		{
+			fill_snapshot(*live_stats_snapshot, publish_number);
+			live_stats_publisher.publish(*live_stats_snapshot);
+		}
+
+		return 0;
+	}
+
+	int run_reader(const std::wstring &mapping_name, uint32_t reader_index)
+	{
+		auto start_time = std::chrono::steady_clock::now();
+
+		// The writer may not have created the live stats yet
+		CLiveStatsReader live_stats_reader;
+		while (!live_stats_reader.init(mapping_name.data()))
+		{
+			if (std::chrono::steady_clock::now() - start_time > reader_timeout)
+			{
+				std::cout << "FAILED: reader " << reader_index << " can't open the live stats" << std::endl;
+				return 1;
+			}
+
+			std::this_thread::yield();
+		}
+
+		std::unique_ptr<SLiveStatsSnapshot> live_stats_snapshot(new SLiveStatsSnapshot());
+		uint64_t read_count = 0, distinct_snapshot_count = 0, torn_read_count = 0, backward_read_count = 0, last_publish_number = 0;
+		while (last_publish_number < publish_count && std::chrono::steady_clock::now() - start_time < reader_timeout)
+		{
+			read_count++;
+			if (!live_stats_reader.read(*live_stats_snapshot))
+			{
+				continue; // Nothing published yet, or the writer kept racing this reader
+			}
+
+			uint64_t publish_number = live_stats_snapshot->written_record_count;
+			if (!is_snapshot_consistent(*live_stats_snapshot))
+			{
+				torn_read_count++;
+			}
+			else if (publish_number < last_publish_number)
+			{
+				backward_read_count++;
+			}
+			else if (publish_number > last_publish_number)
+			{
+				distinct_snapshot_count++;
+				last_publish_number = publish_number;
+			}
+		}
+
+		std::cout << "reader " << reader_index << ": " << read_count << " reads, " << distinct_snapshot_count << " distinct snapshots, " << torn_read_count <<
+			" torn, " << backward_read_count << " went back, reached " << last_publish_number << " of " << publish_count << std::endl;
+
+		return torn_read_count == 0 && backward_read_count == 0 && last_publish_number == publish_count ? 0 : 1;
+	}
+}
+
+int main()
+{
+	std::wstring mapping_name = L"Local\\AppInputMonitorLiveStatsTest" + std::to_wstring(::getpid());
+	CSharedMemory::remove(mapping_name.data());
+
+	std::vector<pid_t> process_ids;
+	for (uint32_t reader_index = 0; reader_index < reader_count; reader_index++)
+	{
+		pid_t process_id = ::fork();
+		if (process_id == 0)
+		{
+			::_exit(run_reader(mapping_name, reader_index));
+		}
+		process_ids.push_back(process_id);
+	}
+
+	pid_t writer_process_id = ::fork();
+	if (writer_process_id == 0)
+	{
+		::_exit(run_writer(mapping_name));
+	}
+	process_ids.push_back(writer_process_id);
+
+	uint32_t failure_count = 0;
+	for (pid_t process_id : process_ids)
+	{
+		int process_status = 0;
+		if (process_id == -1 || ::waitpid(process_id, &process_status, 0) == -1 || !WIFEXITED(process_status) || WEXITSTATUS(process_status) != 0)
+		{
+			failure_count++;
+		}
+	}
+
+	CSharedMemory::remove(mapping_name.data());
+
+	std::cout << (failure_count ? "FAILED" : "PASSED") << std::endl;
+
+	return failure_count ? 1 : 0;
+}
\ No newline at end of file
@@ -0,0 +1,252 @@
+//
+//
+
+#include "stdafx.h"
+
+#include "file_system.h"
+#include "log_index.h"
+#include "file_writer.h"
+#include "log_compactor.h"
+
+// Parses logs in the formats the monitor writes: records carrying the app name by default, records carrying an app id after the record
+// that maps it with a shared app identity table, and in both the record written before the first app switch, whose name is empty. Parsing has to stay linear in the size of the log, the monitor
+// parses whole segments and day files on startup and on every compaction pass.
+//
+// Also checks that the index knows the time range of segments written before a crash, so that readers can skip the segments outside
+// the range they are after.
+
+namespace
+{
+	constexpr uint64_t small_record_count = 4000;
+	constexpr uint64_t large_record_count = 64000; // Around six times the records of a full segment
+	constexpr auto max_large_parse_time = std::chrono::seconds(2); // A quadratic parse takes minutes
+
+	constexpr uint64_t segment_record_count = 60;
+	constexpr uint64_t test_segment_size = 1024; // About a dozen records
+	constexpr uint64_t first_record_time = 1000000;
+	constexpr uint64_t record_interval = 1000;
+
+	uint32_t g_failure_count = 0;
+
+	void check(bool condition, const std::string &description)
+	{
+		if (!condition)
+		{
+			std::cout << "FAILED: " << description << std::endl;
+			g_failure_count++;
+		}
+	}
+
+	// The log and the duration it holds for every app
+	std::wstring generate_log(uint64_t record_count, bool is_app_id_used, std::map<std::wstring, uint64_t> &app_durations)
+	{
+		std::mt19937 random_generator(static_cast<uint32_t>(record_count));
+
+		std::wstring log_data;
+		std::set<uint32_t> mapped_app_ids;
+		for (uint64_t record_index = 0; record_index < record_count; record_index++)
+		{
+			uint32_t app_index = record_index ? 1 + random_generator() % 50 : 0;
+			std::wstring app_path = app_index ? L"C:\\Program Files\\app " + std::to_wstring(app_index) + L"\\app.exe" : L"";
+			uint64_t duration = random_generator() % 10000;
+			uint64_t record_time = 1000000 + record_index * 10000;
+
+			// The empty path never gets an id
+			if (is_app_id_used && app_index)
+			{
+				if (mapped_app_ids.insert(app_index).second)
+				{
+					log_data += L"{\n\n\t \"app_id\" : " + std::to_wstring(app_index) + L",\n\t \"app_name\" : \"" + app_path + L"\"\n}\n";
+				}
+
+				log_data += L"{\n\n\t \"app_id\" : " + std::to_wstring(app_index) + L",\n\t \"duration\" : " + std::to_wstring(duration) +
+					L",\n\t \"time\" : " + std::to_wstring(record_time) + L"\n}\n";
+			}
+			else
+			{
+				log_data += L"{\n\n\t \"app_name\" : \"" + app_path + L"\",\n\t \"duration\" : " + std::to_wstring(duration) +
+					L",\n\t \"time\" : " + std::to_wstring(record_time) + L"\n}\n";
+			}
+
+			app_durations[app_path] += duration;
+		}
+
+		return log_data;
+	}
+
+	std::chrono::milliseconds test_parse(uint64_t record_count, bool is_app_id_used)
+	{
+		std::map<std::wstring, uint64_t> expected_app_durations;
+		std::wstring log_data = generate_log(record_count, is_app_id_used, expected_app_durations);
+
+		std::vector<SAppUsageRecord> app_usage_records;
+		auto start_time = std::chrono::steady_clock::now();
+		bool is_parsed = CLogCompactor::parse_records(log_data, app_usage_records);
+		auto parse_time = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start_time);
+
+		std::map<std::wstring, uint64_t> app_durations;
+		for (const auto &app_usage_record : app_usage_records)
+		{
+			app_durations[app_usage_record.app_name] += app_usage_record.duration;
+		}
+
+		std::string test_name = std::to_string(record_count) + (is_app_id_used ? " records with app ids" : " records with app names");
+		check(is_parsed, test_name + ": the log parses");
+		check(app_usage_records.size() == record_count, test_name + ": every record is read, including the ones with an empty name (" +
+			std::to_string(app_usage_records.size()) + " read)");
+		check(app_durations == expected_app_durations, test_name + ": the ids resolve to their app names");
+		check(app_usage_records.empty() || app_usage_records.back().record_time == 1000000 + (record_count - 1) * 10000, test_name + ": the record times are read");
+
+		std::cout << test_name << " (" << log_data.size() * sizeof(wchar_t) / 1024 << " KiB in memory) parsed in " << parse_time.count() << " ms" << std::endl;
+
+		return parse_time;
+	}
+
+	void test_compacted_through()
+	{
+		std::wstring day_data = L"{\n\n\t \"compacted_through\" : 42\n}\n{\n\n\t \"app_name\" : \"app.exe\",\n\t \"duration\" : 5,\n\t \"time\" : 7\n}\n";
+
+		std::vector<SAppUsageRecord> app_usage_records;
+		uint32_t compacted_through_segment = 0;
+		check(CLogCompactor::parse_records(day_data, app_usage_records, &compacted_through_segment) && compacted_through_segment == 42 &&
+			app_usage_records.size() == 1 && app_usage_records[0].duration == 5, "the day file header is read");
+
+		// A segment has no header, the first record must not be taken for one
+		app_usage_records.clear();
+		compacted_through_segment = 1;
+		check(CLogCompactor::parse_records(day_data.substr(day_data.find(L"\n}\n") + 3), app_usage_records, &compacted_through_segment) &&
+			compacted_through_segment == 0 && app_usage_records.size() == 1, "a log without a header has compacted nothing");
+	}
+
+	std::wstring get_record(uint64_t duration, uint64_t record_time)
+	{
+		return L"{\n\n\t \"app_name\" : \"app.exe\",\n\t \"duration\" : " + std::to_wstring(duration) + L",\n\t \"time\" : " +
+			std::to_wstring(record_time) + L"\n}\n";
+	}
+
+	const SLogIndexEntry *find_segment_entry(const std::vector<SLogIndexEntry> &index_entries, uint32_t segment_number)
+	{
+		for (const auto &index_entry : index_entries)
+		{
+			if (index_entry.entry_type == ELogIndexEntryType::segment && index_entry.segment_number == segment_number)
+			{
+				return &index_entry;
+			}
+		}
+
+		return nullptr;
+	}
+
+	void test_time_range()
+	{
+		char directory_template[] = "/tmp/log_compactor_test_XXXXXX";
+		if (!::mkdtemp(directory_template))
+		{
+			check(false, "the test directory can be created");
+			return;
+		}
+		std::string directory = directory_template;
+		const std::wstring file_prefix = std::wstring(directory.begin(), directory.end()) + L"/app_input_data";
+
+		// Records spread over several segments, the last of which is still open when the monitor crashes
+		uint32_t open_segment_number = 0;
+		{
+			CLogIndex log_index;
+			log_index.init((file_prefix + L".index").data());
+			CFileWriter file_writer;
+			file_writer.init(file_prefix.data(), &log_index, 0, test_segment_size, UINT64_MAX);
+			for (uint64_t record_index = 0; record_index < segment_record_count; record_index++)
+			{
+				file_writer.write_data(get_record(record_index + 1, first_record_time + record_index * record_interval).data(),
+					first_record_time + record_index * record_interval);
+			}
+			open_segment_number = file_writer.get_segment_number();
+		}
+		const uint64_t last_record_time = first_record_time + (segment_record_count - 1) * record_interval;
+
+		// Resuming the open segment rebuilds the range the crash lost
+		{
+			CLogIndex log_index;
+			log_index.init((file_prefix + L".index").data());
+			log_index.load();
+			const SLogIndexEntry *open_entry = find_segment_entry(log_index.get_entries(), open_segment_number);
+			check(open_entry && open_entry->first_record_time == 0, "the crash lost the range of the open segment");
+
+			CFileWriter file_writer;
+			file_writer.init(file_prefix.data(), &log_index, 0, test_segment_size, UINT64_MAX);
+			check(file_writer.get_segment_number() == open_segment_number, "the open segment is resumed");
+
+			CLogIndex saved_log_index;
+			saved_log_index.init((file_prefix + L".index").data());
+			saved_log_index.load();
+			open_entry = find_segment_entry(saved_log_index.get_entries(), open_segment_number);
+			check(open_entry && open_entry->first_record_time > first_record_time && open_entry->last_record_time == last_record_time,
+				"the range of the resumed segment is rebuilt and saved");
+		}
+
+		// Without the index every segment is found on disk and gets its range back
+		CFileSystem::delete_file(file_prefix + L".index");
+		CLogIndex log_index;
+		log_index.init((file_prefix + L".index").data());
+		{
+			CFileWriter file_writer;
+			file_writer.init(file_prefix.data(), &log_index, 0, test_segment_size, UINT64_MAX);
+		}
+
+		std::vector<SLogIndexEntry> index_entries = log_index.get_entries();
+		uint64_t previous_last_record_time = 0;
+		bool is_range_rebuilt = true;
+		for (uint32_t segment_number = 1; segment_number <= open_segment_number; segment_number++)
+		{
+			const SLogIndexEntry *index_entry = find_segment_entry(index_entries, segment_number);
+			is_range_rebuilt = is_range_rebuilt && index_entry && index_entry->first_record_time > previous_last_record_time &&
+				index_entry->last_record_time >= index_entry->first_record_time;
+			previous_last_record_time = index_entry ? index_entry->last_record_time : UINT64_MAX;
+		}
+		check(open_segment_number > 2 && is_range_rebuilt && previous_last_record_time == last_record_time, "the ranges of segments missing from the index are rebuilt");
+
+		// Only the segments holding records of the time asked for are read. The first segment gets a record of that time appended behind the
+		// index's back, which would be counted if the segment was read.
+		const uint64_t from_time = last_record_time - 5 * record_interval;
+		std::wofstream first_segment(CFileSystem::get_stream_name(CFileWriter::get_segment_file_name(file_prefix, 1)).data(), std::ios::app);
+		first_segment << get_record(1000000, from_time);
+		first_segment.close();
+
+		std::vector<SLogIndexEntry> found_entries = log_index.find_files(from_time, UINT64_MAX);
+		check(!found_entries.empty() && std::none_of(found_entries.begin(), found_entries.end(), [](const SLogIndexEntry &index_entry) { return index_entry.segment_number == 1; }),
+			"the segments before the time asked for aren't found");
+
+		uint64_t expected_duration = 0;
+		for (uint64_t record_index = 0; record_index < segment_record_count; record_index++)
+		{
+			expected_duration += first_record_time + record_index * record_interval >= from_time ? record_index + 1 : 0;
+		}
+
+		std::map<std::wstring, uint64_t> app_durations;
+		CLogCompactor::sum_app_durations(file_prefix, log_index, from_time, app_durations);
+		check(app_durations[L"app.exe"] == expected_duration, "the durations since the time asked for are summed (" +
+			std::to_string(app_durations[L"app.exe"]) + " != " + std::to_string(expected_duration) + ")");
+
+		for (const auto &file_name : CFileSystem::find_files(file_prefix + L"*"))
+		{
+			CFileSystem::delete_file(file_name);
+		}
+		::rmdir(directory.data());
+	}
+}
+
+int main()
+{
+	test_compacted_through();
+	test_time_range();
+
+	for (bool is_app_id_used : { false, true })
+	{
+		test_parse(small_record_count, is_app_id_used);
+		check(test_parse(large_record_count, is_app_id_used) <= max_large_parse_time, "a large log parses in linear time");
+	}
+
+	std::cout << (g_failure_count ? "FAILED" : "PASSED") << std::endl;
+
+	return g_failure_count ? 1 : 0;
+}
\ No newline at end of file
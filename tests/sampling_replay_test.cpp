@@ -0,0 +1,249 @@
+//
+//
+
+#include "stdafx.h"
+
+#include "checkpoint.h"
+#include "adaptive_sampling.h"
+#include "input_accounting.h"
+#include "input_trace.h"
+#include "sampling_replay.h"
+
+// Replays input sessions with and without adaptive sampling: a synthesized session of desk work, stretches of continuous mouse movement
+// at common report rates, and the traces recorded with /record_input given on the command line. The adaptive total may only exceed the
+// full rate total by what the sampling policy documents, the idle gaps short enough to fall between two probes, and may fall short of it
+// by no more than a probe interval for every button pressed while throttled. Throttling also has to save most of the wakeups, by orders of
+// magnitude during continuous mouse movement, where the wakeups approach one per probe interval.
+
+namespace
+{
+	constexpr uint64_t max_error_permille = 20; // The stated accuracy of adaptive sampling against full rate input
+
+	constexpr uint32_t desk_session_seed = 20261019;
+	constexpr uint64_t desk_session_duration = 15 * 60 * 1000;
+	constexpr uint64_t min_desk_wakeup_reduction = 4; // Typing, clicks and idle time aren't throttled, only the pointing in between
+
+	struct SContinuousMovement
+	{
+		const char *movement_name;
+		uint64_t report_interval; // Milliseconds
+		uint64_t min_wakeup_reduction;
+	};
+
+	constexpr uint64_t continuous_movement_duration = 5 * 60 * 1000;
+	constexpr SContinuousMovement continuous_movements[] =
+	{
+		{ "continuous movement at 125 Hz", 8, 20 }, // At most 31x, a probe interval's worth of reports per probe
+		{ "continuous movement at 1000 Hz", 1, 100 }, // At most 250x
+	};
+
+	uint32_t g_failure_count = 0;
+
+	struct STraceBounds
+	{
+		uint64_t max_overcount, max_undercount; // Milliseconds
+	};
+
+	void add_event(std::vector<SInputTraceEvent> &trace_events, uint64_t event_time, EInputTraceEvent trace_event, uint16_t input_code = 0)
+	{
+		SInputTraceEvent input_trace_event = {};
+		input_trace_event.event_time = event_time;
+		input_trace_event.trace_event = trace_event;
+		input_trace_event.input_code = input_code;
+		trace_events.push_back(input_trace_event);
+	}
+
+	// Typing, pointing and clicking, drags, scrolling while reading and idle time, at a 125 Hz mouse
+	std::vector<SInputTraceEvent> generate_desk_session(uint32_t session_seed)
+	{
+		std::mt19937 random_generator(session_seed);
+		auto random_between = [&random_generator](uint64_t low, uint64_t high) { return low + random_generator() % (high - low + 1); };
+		auto random_permille = [&random_generator]() { return random_generator() % 1000; };
+
+		std::vector<SInputTraceEvent> trace_events;
+		auto move = [&](uint64_t event_time, uint64_t duration, bool is_hesitating)
+		{
+			for (uint64_t end_time = event_time + duration; event_time < end_time; event_time += random_between(7, 9))
+			{
+				add_event(trace_events, event_time, EInputTraceEvent::mouse_movement);
+				if (is_hesitating && random_permille() < 4)
+				{
+					event_time += random_between(100, 900); // Below the idle gap
+				}
+			}
+
+			return event_time;
+		};
+
+		const uint16_t virtual_keys[] = { 0x41, 0x45, 0x49, 0x4e, 0x4f, 0x52, 0x53, 0x54, 0x20, 0x0d, 0x08, 0x10 };
+		uint64_t event_time = 1000;
+		while (event_time < 1000 + desk_session_duration)
+		{
+			uint64_t activity = random_permille();
+			if (activity < 250) // Typing
+			{
+				for (uint64_t key_count = random_between(5, 120); key_count; key_count--)
+				{
+					uint16_t virtual_key = virtual_keys[random_generator() % (sizeof(virtual_keys) / sizeof(virtual_keys[0]))];
+					add_event(trace_events, event_time, EInputTraceEvent::key_down, virtual_key);
+					add_event(trace_events, event_time + random_between(40, 140), EInputTraceEvent::key_up, virtual_key);
+					event_time += random_between(60, 350) + (random_permille() < 30 ? random_between(500, 2500) : 0);
+				}
+			}
+			else if (activity < 600) // Pointing and clicking
+			{
+				for (uint64_t point_count = random_between(1, 6); point_count; point_count--)
+				{
+					event_time = move(event_time, random_between(300, 12000), true);
+					if (random_permille() < 600)
+					{
+						uint16_t button_flag = random_permille() < 750 ? 0x0001 : 0x0004; // RI_MOUSE_LEFT_BUTTON_DOWN or RIGHT
+						add_event(trace_events, event_time, EInputTraceEvent::button_down, button_flag);
+						event_time += random_between(60, 160);
+						add_event(trace_events, event_time, EInputTraceEvent::button_up, button_flag);
+					}
+					event_time += random_between(50, 1400);
+				}
+			}
+			else if (activity < 700) // Drag, sometimes holding still before dropping
+			{
+				event_time = move(event_time, random_between(200, 1500), true);
+				add_event(trace_events, event_time, EInputTraceEvent::button_down, 0x0001);
+				event_time = move(event_time + random_between(50, 400), random_between(300, 4000), false);
+				event_time += random_permille() < 200 ? random_between(300, 2500) : 0;
+				add_event(trace_events, event_time, EInputTraceEvent::button_up, 0x0001);
+			}
+			else if (activity < 800) // Scrolling while reading
+			{
+				for (uint64_t scroll_count = random_between(1, 10); scroll_count; scroll_count--)
+				{
+					for (uint64_t notch_count = random_between(2, 15); notch_count; notch_count--)
+					{
+						add_event(trace_events, event_time, EInputTraceEvent::mouse_wheel);
+						event_time += random_between(15, 60);
+					}
+					event_time += random_between(200, 3000);
+				}
+			}
+			else
+			{
+				event_time += activity < 950 ? random_between(1000, 20000) : random_between(20000, 120000);
+			}
+		}
+
+		// Key releases overlap the next key press
+		std::stable_sort(trace_events.begin(), trace_events.end(),
+			[](const SInputTraceEvent &first_event, const SInputTraceEvent &second_event) { return first_event.event_time < second_event.event_time; });
+
+		return trace_events;
+	}
+
+	// Moving the mouse without a break, e.g. drawing or gaming, ended with a click
+	std::vector<SInputTraceEvent> generate_continuous_movement(uint64_t report_interval)
+	{
+		std::vector<SInputTraceEvent> trace_events;
+		uint64_t event_time = 1000;
+		for (; event_time < 1000 + continuous_movement_duration; event_time += report_interval)
+		{
+			add_event(trace_events, event_time, EInputTraceEvent::mouse_movement);
+		}
+		add_event(trace_events, event_time, EInputTraceEvent::button_down, 0x0001);
+		add_event(trace_events, event_time + 100, EInputTraceEvent::button_up, 0x0001);
+
+		return trace_events;
+	}
+
+	STraceBounds get_trace_bounds(const std::vector<SInputTraceEvent> &trace_events)
+	{
+		STraceBounds trace_bounds = {};
+
+		std::map<uint16_t, uint64_t> button_down_times;
+		for (size_t event_index = 0; event_index < trace_events.size(); event_index++)
+		{
+			const SInputTraceEvent &trace_event = trace_events[event_index];
+
+			if (event_index)
+			{
+				uint64_t idle_gap = trace_event.event_time - trace_events[event_index - 1].event_time;
+				if (idle_gap >= INPUT_POINTER_IDLE_GAP && idle_gap < ADAPTIVE_SAMPLING_EXIT_IDLE + ADAPTIVE_SAMPLING_PROBE_INTERVAL)
+				{
+					trace_bounds.max_overcount += idle_gap;
+				}
+			}
+
+			if (trace_event.trace_event == EInputTraceEvent::button_down)
+			{
+				button_down_times[trace_event.input_code] = trace_event.event_time;
+			}
+			else if (trace_event.trace_event == EInputTraceEvent::button_up && button_down_times.count(trace_event.input_code))
+			{
+				trace_bounds.max_undercount += std::min<uint64_t>(trace_event.event_time - button_down_times[trace_event.input_code], ADAPTIVE_SAMPLING_PROBE_INTERVAL);
+				button_down_times.erase(trace_event.input_code);
+			}
+		}
+
+		return trace_bounds;
+	}
+
+	void replay_trace(const std::string &trace_name, const std::vector<SInputTraceEvent> &trace_events, uint64_t min_wakeup_reduction)
+	{
+		SAdaptiveSamplingReplay sampling_replay = CSamplingReplay::replay(trace_events);
+		const SSamplingReplayRun &full_rate = sampling_replay.full_rate;
+		const SSamplingReplayRun &adaptive = sampling_replay.adaptive;
+		STraceBounds trace_bounds = get_trace_bounds(trace_events);
+
+		uint64_t error = full_rate.active_time > adaptive.active_time ? full_rate.active_time - adaptive.active_time : adaptive.active_time - full_rate.active_time;
+		uint64_t error_permille = full_rate.active_time ? error * 1000 / full_rate.active_time : 0;
+
+		std::cout << trace_name << ": " << trace_events.size() << " events, " << full_rate.wakeup_count << " -> " << adaptive.wakeup_count <<
+			" wakeups (" << (adaptive.wakeup_count ? full_rate.wakeup_count / adaptive.wakeup_count : 0) << "x fewer), " << full_rate.active_time << " -> " <<
+			adaptive.active_time << " ms active (" << error << " ms off, " << error_permille << " permille, bounds -" << trace_bounds.max_undercount << " +" <<
+			trace_bounds.max_overcount << " ms), " << adaptive.mode_switch_count << " mode switches, " << full_rate.missed_input_event_count << " -> " <<
+			adaptive.missed_input_event_count << " missed events" << std::endl;
+
+		if (adaptive.active_time > full_rate.active_time + trace_bounds.max_overcount || adaptive.active_time + trace_bounds.max_undercount < full_rate.active_time)
+		{
+			std::cout << "FAILED: the adaptive total is outside the documented bounds" << std::endl;
+			g_failure_count++;
+		}
+
+		if (error_permille > max_error_permille)
+		{
+			std::cout << "FAILED: the adaptive total is off by more than " << max_error_permille << " permille" << std::endl;
+			g_failure_count++;
+		}
+
+		if (adaptive.wakeup_count * min_wakeup_reduction > full_rate.wakeup_count)
+		{
+			std::cout << "FAILED: adaptive sampling saves less than " << min_wakeup_reduction << "x the wakeups" << std::endl;
+			g_failure_count++;
+		}
+	}
+}
+
+int main(int argument_count, char *arguments[])
+{
+	replay_trace("desk session", generate_desk_session(desk_session_seed), min_desk_wakeup_reduction);
+	for (const auto &continuous_movement : continuous_movements)
+	{
+		replay_trace(continuous_movement.movement_name, generate_continuous_movement(continuous_movement.report_interval), continuous_movement.min_wakeup_reduction);
+	}
+
+	for (int argument_index = 1; argument_index < argument_count; argument_index++)
+	{
+		std::ifstream trace_file(arguments[argument_index]);
+		std::vector<SInputTraceEvent> trace_events;
+		if (!trace_file.is_open() || !CInputTrace::load(trace_file, trace_events) || trace_events.empty())
+		{
+			std::cout << "FAILED: can't load " << arguments[argument_index] << std::endl;
+			g_failure_count++;
+			continue;
+		}
+
+		replay_trace(arguments[argument_index], trace_events, min_desk_wakeup_reduction);
+	}
+
+	std::cout << (g_failure_count ? "FAILED" : "PASSED") << std::endl;
+
+	return g_failure_count ? 1 : 0;
+}
\ No newline at end of file
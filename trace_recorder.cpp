@@ -0,0 +1,178 @@
+//
+//
+
+#include "stdafx.h"
+
+#include "file_system.h"
+#include "trace_recorder.h"
+
+namespace
+{
+	thread_local STraceBuffer *t_trace_buffer = nullptr;
+
+	// Microseconds with three decimals, written from integers so that long sessions keep their nanosecond resolution
+	void write_trace_time(std::ofstream &trace_file, int64_t trace_time)
+	{
+		trace_file << trace_time / 1000 << '.' << std::setw(3) << std::setfill('0') << trace_time % 1000;
+	}
+}
+
+CTraceRecorder::CTraceRecorder()
+{
+	m_is_enabled = false;
+
+#ifdef _WIN32
+	LARGE_INTEGER performance_frequency = { 0 };
+	::QueryPerformanceFrequency(&performance_frequency);
+	m_performance_frequency = performance_frequency.QuadPart;
+#else
+	m_performance_frequency = 1000000000; // get_time counts nanoseconds
+#endif // _WIN32
+
+	m_session_start_time = get_time();
+}
+
+CTraceRecorder::~CTraceRecorder()
+{
+
+}
+
+void CTraceRecorder::enable(bool is_enabled)
+{
+	m_is_enabled.store(is_enabled, std::memory_order_relaxed);
+}
+
+bool CTraceRecorder::is_enabled() const
+{
+	return m_is_enabled.load(std::memory_order_relaxed);
+}
+
+void CTraceRecorder::record(const char *span_name, int64_t start_time, int64_t end_time)
+{
+	STraceBuffer *trace_buffer = t_trace_buffer ? t_trace_buffer : register_thread_buffer();
+
+	uint32_t event_count = trace_buffer->event_count.load(std::memory_order_relaxed);
+	if (event_count == TRACE_BUFFER_CAPACITY)
+	{
+		trace_buffer->dropped_event_count.fetch_add(1, std::memory_order_relaxed);
+		return;
+	}
+
+	STraceEvent &trace_event = trace_buffer->trace_events[event_count];
+	trace_event.span_name = span_name;
+	trace_event.start_time = start_time;
+	trace_event.end_time = end_time;
+
+	// Publish this span to the dump
+	trace_buffer->event_count.store(event_count + 1, std::memory_order_release);
+}
+
+bool CTraceRecorder::dump(const wchar_t *file_name)
+{
+	std::ofstream trace_file(CFileSystem::get_stream_name(file_name).data(), std::ios::trunc);
+	if (!trace_file.is_open())
+	{
+		return false;
+	}
+
+#ifdef _WIN32
+	DWORD process_id = ::GetCurrentProcessId();
+#else
+	DWORD process_id = static_cast<DWORD>(::getpid());
+#endif // _WIN32
+
+	// Chrome Trace Event format, timestamps are in microseconds since the recorder was created
+	trace_file << "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n";
+	trace_file << "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":" << process_id << ",\"args\":{\"name\":\"app_input_monitor\"}}";
+
+	std::lock_guard<std::mutex> trace_buffers_mutex(m_trace_buffers_mutex);
+	for (const auto &trace_buffer : m_trace_buffers)
+	{
+		uint32_t event_count = trace_buffer->event_count.load(std::memory_order_acquire);
+		for (uint32_t event_index = 0; event_index < event_count; event_index++)
+		{
+			const STraceEvent &trace_event = trace_buffer->trace_events[event_index];
+
+			trace_file << ",\n{\"name\":\"" << trace_event.span_name << "\",\"ph\":\"X\",\"pid\":" << process_id << ",\"tid\":" << trace_buffer->thread_id <<
+				",\"ts\":";
+			write_trace_time(trace_file, get_nanoseconds(trace_event.start_time - m_session_start_time));
+			trace_file << ",\"dur\":";
+			write_trace_time(trace_file, get_nanoseconds(trace_event.end_time - trace_event.start_time));
+			trace_file << "}";
+		}
+
+		uint32_t dropped_event_count = trace_buffer->dropped_event_count.load(std::memory_order_relaxed);
+		if (dropped_event_count)
+		{
+			trace_file << ",\n{\"name\":\"dropped_spans\",\"ph\":\"C\",\"pid\":" << process_id << ",\"tid\":" << trace_buffer->thread_id <<
+				",\"ts\":0,\"args\":{\"dropped\":" << dropped_event_count << "}}";
+		}
+	}
+
+	trace_file << "\n]}\n";
+
+	return static_cast<bool>(trace_file);
+}
+
+int64_t CTraceRecorder::get_time()
+{
+#ifdef _WIN32
+	LARGE_INTEGER performance_count = { 0 };
+	::QueryPerformanceCounter(&performance_count);
+
+	return performance_count.QuadPart;
+#else
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif // _WIN32
+}
+
+int64_t CTraceRecorder::get_nanoseconds(int64_t performance_ticks) const
+{
+	// Whole seconds first, the ticks of a long session times a billion would overflow
+	return performance_ticks / m_performance_frequency * 1000000000 + performance_ticks % m_performance_frequency * 1000000000 / m_performance_frequency;
+}
+
+STraceBuffer *CTraceRecorder::register_thread_buffer()
+{
+	std::unique_ptr<STraceBuffer> trace_buffer(new STraceBuffer);
+#ifdef _WIN32
+	trace_buffer->thread_id = ::GetCurrentThreadId();
+#else
+	trace_buffer->thread_id = static_cast<DWORD>(std::hash<std::thread::id>()(std::this_thread::get_id()));
+#endif // _WIN32
+	trace_buffer->event_count = 0;
+	trace_buffer->dropped_event_count = 0;
+
+	// The buffer outlives its thread so that spans recorded by short lived timer threads still make it into the dump
+	std::lock_guard<std::mutex> trace_buffers_mutex(m_trace_buffers_mutex);
+	t_trace_buffer = trace_buffer.get();
+	m_trace_buffers.push_back(std::move(trace_buffer));
+
+	return t_trace_buffer;
+}
+
+CTraceScope::CTraceScope(const char *span_name)
+{
+	m_span_name = span_name;
+
+	// Tracing is off by default, in which case a span costs one relaxed load
+	m_start_time = g_trace_recorder->is_enabled() ? CTraceRecorder::get_time() : 0;
+}
+
+CTraceScope::~CTraceScope()
+{
+	end();
+}
+
+void CTraceScope::end()
+{
+	if (m_start_time)
+	{
+		g_trace_recorder->record(m_span_name, m_start_time, CTraceRecorder::get_time());
+		m_start_time = 0;
+	}
+}
+
+// Never destroyed. Spans are recorded until the process is gone, including from the destructors of other globals, which may run after
+// the globals of this file have been destroyed.
+CTraceRecorder *g_trace_recorder = new CTraceRecorder;
\ No newline at end of file
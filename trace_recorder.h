@@ -0,0 +1,79 @@
+//
+//
+
+#pragma once
+
+#define TRACE_BUFFER_CAPACITY	64 * 1024 // Number of spans recorded per thread, later spans are dropped
+
+#define TRACE_CONCATENATE_INNER(first, second)	first##second
+#define TRACE_CONCATENATE(first, second)		TRACE_CONCATENATE_INNER(first, second)
+
+// Records a span covering the rest of the enclosing scope
+#define TRACE_SCOPE(span_name) \
+							CTraceScope TRACE_CONCATENATE(trace_scope_, __LINE__)(span_name)
+
+// Acquires a mutex with a std::lock_guard and records the time spent waiting for it
+#define TRACE_LOCK_GUARD(lock_name, mutex_to_lock) \
+							CTraceScope lock_name##_trace_scope("lock " #mutex_to_lock); \
+							std::lock_guard<std::mutex> lock_name(mutex_to_lock); \
+							lock_name##_trace_scope.end()
+
+struct STraceEvent
+{
+	const char *span_name; // Must be a string literal
+	int64_t start_time, end_time; // Performance counter ticks
+};
+
+// Spans are only ever appended by the thread that owns the buffer, so recording never takes a lock. The event count is published with
+// release semantics so that the dump can read every span below it while the owning thread keeps recording.
+struct STraceBuffer
+{
+	DWORD thread_id;
+	std::atomic<uint32_t> event_count;
+	std::atomic<uint32_t> dropped_event_count;
+	STraceEvent trace_events[TRACE_BUFFER_CAPACITY];
+};
+
+class CTraceRecorder
+{
+public:
+	CTraceRecorder();
+	~CTraceRecorder(); // Never runs for g_trace_recorder
+
+	void enable(bool is_enabled);
+	bool is_enabled() const;
+
+	void record(const char *span_name, int64_t start_time, int64_t end_time);
+
+	bool dump(const wchar_t *file_name);
+
+	static int64_t get_time();
+
+private:
+	STraceBuffer *register_thread_buffer();
+
+	int64_t get_nanoseconds(int64_t performance_ticks) const;
+
+	std::atomic<bool> m_is_enabled;
+
+	int64_t m_performance_frequency;
+	int64_t m_session_start_time; // Performance counter ticks, the dump counts from here
+
+	std::mutex m_trace_buffers_mutex; // Only taken the first time a thread records a span and while dumping
+	std::vector<std::unique_ptr<STraceBuffer>> m_trace_buffers;
+};
+
+extern CTraceRecorder *g_trace_recorder;
+
+class CTraceScope
+{
+public:
+	explicit CTraceScope(const char *span_name);
+	~CTraceScope();
+
+	void end();
+
+private:
+	const char *m_span_name;
+	int64_t m_start_time;
+};
\ No newline at end of file